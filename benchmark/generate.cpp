@@ -0,0 +1,242 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ****************************************************************************/
+
+/* Generates a synthetic C++ library for benchmarking tau_wrap++.
+ * Everything is in the "synth" namespace:
+ *   - N nested namespaces, each with M classes
+ *   - each class has K overloads of compute(), plus a const method,
+ *     a static method, a constructor and a destructor
+ *   - T class templates and T classes with a member function template
+ *     per namespace, explicitly instantiated for int, float and double
+ *   - a percentage of the parameters are spelled with "using" aliases
+ * Writes synth.h, synth.cpp and config.json to the output directory. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+typedef struct options {
+    size_t namespaces;
+    size_t classes;
+    size_t overloads;
+    size_t templates;
+    size_t aliasPercent;
+    std::string directory;
+} options_t;
+
+/* The parameter types the overloads are made of, and the aliases for them */
+const char * parameterTypes[] = {"int", "double", "const std::string &",
+    "const std::vector<int> &", "long", "float", "std::vector<double>",
+    "unsigned int"};
+const char * aliasNames[] = {"Index", "Value", "Name", "Indices", "Size",
+    "Scale", "Values", "Count"};
+const size_t numParameterTypes = sizeof(parameterTypes) / sizeof(const char *);
+const char * templateTypes[] = {"int", "float", "double"};
+
+/* A fixed pseudo-random sequence, so the library is the same every time */
+size_t nextRandom() {
+    static uint64_t state{88172645463325252ULL};
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (size_t)state;
+}
+
+void show_usage(char const * argv0) {
+    std::cout << "Usage : " << argv0 << " [-n <namespaces>] [-m <classes>]"
+              << " [-k <overloads>] [-t <templates>] [-a <alias percent>]"
+              << " [-o <directory>]" << std::endl;
+}
+
+/* The type of parameter p of overload k, with or without the alias */
+std::string parameterType(size_t k, size_t p, bool alias) {
+    size_t index = (k + p * 3) % numParameterTypes;
+    if (alias) {
+        return aliasNames[index];
+    }
+    return parameterTypes[index];
+}
+
+void writeHeader(const options_t& options) {
+    std::stringstream h;
+    h << "#pragma once\n\n";
+    h << "#include <string>\n#include <vector>\n\n";
+    h << "namespace synth {\n\n";
+    for (size_t t = 0 ; t < numParameterTypes ; t++) {
+        std::string type{parameterTypes[t]};
+        // aliases are for the type, not the reference
+        if (type.compare(0, 6, "const ") == 0) {
+            type = type.substr(6, type.size() - 8);
+            h << "using " << aliasNames[t] << "Type = " << type << ";\n";
+        } else {
+            h << "using " << aliasNames[t] << " = " << type << ";\n";
+        }
+    }
+    h << "\n";
+    for (size_t n = 0 ; n < options.namespaces ; n++) {
+        h << "namespace ns" << n << " {\n\n";
+        for (size_t m = 0 ; m < options.classes ; m++) {
+            h << "class Class" << m << " {\n";
+            h << "public:\n";
+            h << "    Class" << m << "();\n";
+            h << "    ~Class" << m << "();\n";
+            for (size_t k = 0 ; k < options.overloads ; k++) {
+                h << "    double compute(";
+                // k+1 parameters, so the overloads differ in arity and type
+                for (size_t p = 0 ; p <= k ; p++) {
+                    bool alias = (nextRandom() % 100) < options.aliasPercent;
+                    std::string type{parameterType(k, p, alias)};
+                    std::string plain{parameterType(k, p, false)};
+                    if (alias && plain.compare(0, 6, "const ") == 0) {
+                        type = "const " + type + "Type &";
+                    }
+                    h << (p > 0 ? ", " : "") << type << " arg" << p;
+                }
+                h << ");\n";
+            }
+            h << "    std::string name() const;\n";
+            h << "    static int count(int scale);\n";
+            h << "private:\n";
+            h << "    double state;\n";
+            h << "};\n\n";
+        }
+        for (size_t t = 0 ; t < options.templates ; t++) {
+            h << "template<typename T>\n";
+            h << "class Container" << t << " {\n";
+            h << "public:\n";
+            h << "    T get(T value) const;\n";
+            h << "    void put(const std::vector<T>& values);\n";
+            h << "private:\n";
+            h << "    T total;\n";
+            h << "};\n\n";
+            h << "class Converter" << t << " {\n";
+            h << "public:\n";
+            h << "    template<typename T>\n";
+            h << "    T convert(T value);\n";
+            h << "};\n\n";
+        }
+        h << "} // namespace ns" << n << "\n\n";
+    }
+    h << "} // namespace synth\n";
+    std::ofstream out(options.directory + "/synth.h");
+    out << h.rdbuf();
+}
+
+void writeSource(const options_t& options) {
+    std::stringstream s;
+    s << "#include \"synth.h\"\n\n";
+    s << "namespace synth {\n\n";
+    for (size_t n = 0 ; n < options.namespaces ; n++) {
+        s << "namespace ns" << n << " {\n\n";
+        for (size_t m = 0 ; m < options.classes ; m++) {
+            std::string c{"Class" + std::to_string(m)};
+            s << c << "::" << c << "() : state(0.0) {}\n";
+            s << c << "::~" << c << "() {}\n";
+            for (size_t k = 0 ; k < options.overloads ; k++) {
+                // the definitions don't use the aliases
+                s << "double " << c << "::compute(";
+                for (size_t p = 0 ; p <= k ; p++) {
+                    s << (p > 0 ? ", " : "") << parameterType(k, p, false);
+                }
+                s << ") { return state += " << k << "; }\n";
+            }
+            s << "std::string " << c << "::name() const { return \"" << c << "\"; }\n";
+            s << "int " << c << "::count(int scale) { return scale * " << m << "; }\n\n";
+        }
+        for (size_t t = 0 ; t < options.templates ; t++) {
+            std::string c{"Container" + std::to_string(t)};
+            s << "template<typename T>\n";
+            s << "T " << c << "<T>::get(T value) const { return value + total; }\n";
+            s << "template<typename T>\n";
+            s << "void " << c << "<T>::put(const std::vector<T>& values) {\n";
+            s << "    for (auto v : values) { total += v; }\n";
+            s << "}\n";
+            s << "template<typename T>\n";
+            s << "T Converter" << t << "::convert(T value) { return value; }\n";
+            for (auto type : templateTypes) {
+                s << "template class " << c << "<" << type << ">;\n";
+                s << "template " << type << " Converter" << t << "::convert<"
+                  << type << ">(" << type << ");\n";
+            }
+            s << "\n";
+        }
+        s << "} // namespace ns" << n << "\n\n";
+    }
+    s << "} // namespace synth\n";
+    std::ofstream out(options.directory + "/synth.cpp");
+    out << s.rdbuf();
+}
+
+void writeConfig(const options_t& options) {
+    std::ofstream out(options.directory + "/config.json");
+    out << R"({
+    "parser_flags": [
+        "-x",
+        "c++",
+        "-std=c++11",
+        "-I.",
+        "-I/usr/include"
+    ],
+    "template_types": [)";
+    for (size_t i = 0 ; i < sizeof(templateTypes) / sizeof(const char *) ; i++) {
+        out << (i > 0 ? "," : "") << "\n        \"" << templateTypes[i] << "\"";
+    }
+    out << R"(
+    ],
+    "classes to skip": [
+    ],
+    "methods to skip": [
+    ],
+    "TAU timer group": "SYNTH",
+    "enable trace plugin": false,
+    "match report": ""
+}
+)";
+}
+
+int main(int argc, char **argv)
+{
+    options_t options{4, 8, 4, 2, 25, "."};
+    for(int i=1; i<argc; i++) {
+        if (i + 1 >= argc) {
+            show_usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "-n") == 0) {
+            options.namespaces = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0) {
+            options.classes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-k") == 0) {
+            options.overloads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            options.templates = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-a") == 0) {
+            options.aliasPercent = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            options.directory = argv[++i];
+        } else {
+            show_usage(argv[0]);
+            return 1;
+        }
+    }
+    writeHeader(options);
+    writeSource(options);
+    writeConfig(options);
+    std::cout << "Generated " << options.namespaces << " namespaces, "
+              << options.namespaces * options.classes << " classes, "
+              << options.namespaces * options.classes * (options.overloads + 4)
+              << " methods and " << options.namespaces * options.templates * 2
+              << " templates (" << options.aliasPercent << "% aliased parameters)"
+              << std::endl;
+    return 0;
+}
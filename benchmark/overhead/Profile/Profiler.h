@@ -0,0 +1,48 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ****************************************************************************/
+
+/* A stand-in for the parts of the TAU API used by the generated wrappers,
+ * so the overhead of the wrappers themselves can be measured without TAU.
+ * The functions are in libtau_stub.so, so they are real calls like they
+ * would be with TAU, but the timers only count. */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef unsigned long TauGroup_t;
+#define TAU_USER 0x80000000
+
+/* Only used to print communicators in traces */
+typedef int MPI_Comm;
+#define MPI_COMM_WORLD ((MPI_Comm)0x44000000)
+#define MPI_COMM_SELF  ((MPI_Comm)0x44000001)
+#define MPI_COMM_NULL  ((MPI_Comm)0x04000000)
+
+void tauCreateFI(void **ptr, const char *name, const char *type,
+    TauGroup_t ProfileGroup, const char *ProfileGroupName);
+void Tau_lite_start_timer(void *fi, int phase);
+void Tau_lite_stop_timer(void *fi);
+int Tau_time_traced_api_call(void);
+void Tau_traced_api_call_enter(void);
+void Tau_traced_api_call_exit(void);
+
+class Tau_Profile_Wrapper {
+public:
+    void *fi;
+    Tau_Profile_Wrapper(void *fi, bool phase = false) : fi(fi) {
+        if (fi != 0) {
+            Tau_lite_start_timer(fi, phase);
+        }
+    }
+    ~Tau_Profile_Wrapper() {
+        if (fi != 0) {
+            Tau_lite_stop_timer(fi);
+        }
+    }
+};
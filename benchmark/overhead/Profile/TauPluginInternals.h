@@ -0,0 +1,17 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ****************************************************************************/
+
+/* Stand-in plugin internals, see Profiler.h */
+
+#pragma once
+
+#include "TauPluginTypes.h"
+
+int TauEnv_get_plugins_enabled(void);
+void Tau_util_invoke_callbacks(Tau_plugin_event event,
+    const char *specific_event_name, const void *data);
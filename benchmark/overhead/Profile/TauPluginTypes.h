@@ -0,0 +1,20 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ****************************************************************************/
+
+/* Stand-in plugin types, see Profiler.h */
+
+#pragma once
+
+enum Tau_plugin_event {
+    TAU_PLUGIN_EVENT_FUNCTION_REGISTRATION,
+    TAU_PLUGIN_EVENT_CURRENT_TIMER_EXIT
+};
+
+typedef struct Tau_plugin_event_current_timer_exit_data {
+    const char *name_prefix;
+} Tau_plugin_event_current_timer_exit_data_t;
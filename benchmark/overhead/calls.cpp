@@ -0,0 +1,41 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ***************************************************************************/
+
+#include "calls.h"
+
+namespace calls {
+
+Target::Target() : count(0) {}
+
+Target::~Target() {}
+
+void Target::noArguments() {
+    count++;
+}
+
+int Target::scalars(int a, double b) {
+    return count += a + (int)b;
+}
+
+size_t Target::text(const std::string& name) {
+    return name.size() + count;
+}
+
+double Target::values(const std::vector<double>& v) {
+    return v.size() > 0 ? v[0] + count : count;
+}
+
+int Target::constMethod() const {
+    return count;
+}
+
+int Target::staticMethod(int a) {
+    return a + 1;
+}
+
+}
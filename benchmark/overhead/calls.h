@@ -0,0 +1,31 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ***************************************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace calls {
+
+/* One method for each kind of call the overhead is measured for */
+class Target {
+public:
+    Target();
+    ~Target();
+    void noArguments();
+    int scalars(int a, double b);
+    size_t text(const std::string& name);
+    double values(const std::vector<double>& v);
+    int constMethod() const;
+    static int staticMethod(int a);
+private:
+    int count;
+};
+
+}
@@ -0,0 +1,89 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ****************************************************************************/
+
+/* Measures the cost of calling each method in calls.h, in nanoseconds and
+ * heap allocations per call.  Run it directly for the baseline, and with a
+ * generated wrapper preloaded to measure the wrapper:
+ *   ./overhead direct
+ *   LD_PRELOAD=./libcalls_wrap.so ./overhead wrapped */
+
+#include "calls.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+
+/* Count every allocation, including the ones made in the wrapper */
+static std::atomic<uint64_t> allocations{0};
+
+void * operator new(size_t size) {
+    allocations++;
+    void * p = malloc(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void * p) noexcept {
+    free(p);
+}
+
+void operator delete(void * p, size_t) noexcept {
+    free(p);
+}
+
+/* Keeps the results, so the calls aren't optimized away */
+static volatile double sink;
+
+template<class F>
+void measure(const char * label, const char * name, size_t iterations, F call) {
+    // the first call looks up the symbol and creates the timer
+    call();
+    uint64_t before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0 ; i < iterations ; i++) {
+        call();
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    uint64_t allocated = allocations - before;
+    printf("%-10s %-14s %12.1f %14.2f\n", label, name,
+        elapsed.count() / iterations, (double)allocated / iterations);
+}
+
+int main(int argc, char **argv)
+{
+    const char * label = argc > 1 ? argv[1] : "direct";
+    size_t iterations = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000000;
+    calls::Target target;
+    std::string name{"a name that is longer than the small string buffer"};
+    std::vector<double> values(16, 1.0);
+    printf("%-10s %-14s %12s %14s\n", "Mode", "Call", "ns/call", "allocs/call");
+    measure(label, "void", iterations, [&]() {
+        target.noArguments();
+    });
+    measure(label, "scalars", iterations, [&]() {
+        sink = target.scalars(1, 2.0);
+    });
+    measure(label, "string", iterations, [&]() {
+        sink = target.text(name);
+    });
+    measure(label, "vector", iterations, [&]() {
+        sink = target.values(values);
+    });
+    measure(label, "const", iterations, [&]() {
+        sink = target.constMethod();
+    });
+    measure(label, "static", iterations, [&]() {
+        sink = calls::Target::staticMethod(1);
+    });
+    return 0;
+}
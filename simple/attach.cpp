@@ -0,0 +1,48 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ***************************************************************************/
+
+/* Attaches and detaches the wrapper generated with "interposition": "got"
+ * while the program runs.  Only two of the calls to foo1 are made while a
+ * wrapper is patched in: run with TAU_WRAP_ATTACH=0, so that the wrapper
+ * doesn't attach as soon as it is opened. */
+
+#include <stdio.h>
+#include <dlfcn.h>
+#include <secret.h>
+
+using namespace secret;
+
+int main(int argc, char **argv)
+{
+    Secret object;
+    object.foo1(1);
+    void * wrapper = dlopen("./libsecret_wrap.so", RTLD_NOW);
+    if (wrapper == nullptr) {
+        fprintf(stderr, "%s\n", dlerror());
+        return 1;
+    }
+    int (*attach)() = (int(*)())dlsym(wrapper, "tau_wrap_attach");
+    int (*detach)() = (int(*)())dlsym(wrapper, "tau_wrap_detach");
+    attach();
+    object.foo1(2);
+    // opened after attaching, so not patched until attaching again
+    void * plugin = dlopen("../libplugin.so", RTLD_NOW);
+    if (plugin == nullptr) {
+        fprintf(stderr, "%s\n", dlerror());
+        return 1;
+    }
+    int (*callFoo1)(Secret&, int) = (int(*)(Secret&, int))dlsym(plugin, "callFoo1");
+    callFoo1(object, 3);
+    attach();
+    callFoo1(object, 4);
+    // still loaded until detaching, which restores its GOT
+    dlclose(plugin);
+    detach();
+    object.foo1(5);
+    return 0;
+}
@@ -0,0 +1,367 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ***************************************************************************/
+
+/* Checks, without TAU, what a program run with one of the wrappers
+ * generated for the builtin profiler wrote.  It is run in the directory
+ * the program ran in, with the name of the run (see the check target in
+ * the Makefile). */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <glob.h>
+#include <string>
+#include <map>
+#include <iostream>
+#include <fstream>
+
+static int failures{0};
+
+static void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+/* The one file the run wrote that matches the pattern */
+static std::string only(const std::string& pattern) {
+    glob_t found;
+    std::string filename;
+    if (glob(pattern.c_str(), 0, nullptr, &found) == 0 && found.gl_pathc == 1) {
+        filename = found.gl_pathv[0];
+    }
+    globfree(&found);
+    check(!filename.empty(), "one " + pattern);
+    return filename;
+}
+
+/* The calls to each timer, from the total of the builtin profile */
+static std::map<std::string, uint64_t> totalCalls() {
+    std::map<std::string, uint64_t> calls;
+    std::ifstream in(only("wrapper_profile.*.txt"));
+    std::string line;
+    bool total{false};
+    while (std::getline(in, line)) {
+        if (line.compare(0, 6, "Total ") == 0) {
+            total = true;
+            std::getline(in, line); // the column names
+            continue;
+        }
+        if (!total) {
+            continue;
+        }
+        if (line.empty()) {
+            break;
+        }
+        double percent, exclusive, inclusive, perCall;
+        unsigned long long count;
+        int name{0};
+        if (sscanf(line.c_str(), "%lf %lf %lf %llu %lf %n", &percent, &exclusive,
+                &inclusive, &count, &perCall, &name) == 5 && name > 0) {
+            check(calls.count(line.substr(name)) == 0, "one timer for " + line.substr(name));
+            calls[line.substr(name)] += count;
+        }
+    }
+    return calls;
+}
+
+/* The bytes moved through each timer, from the total of the builtin profile */
+static std::map<std::string, uint64_t> totalBytes() {
+    std::map<std::string, uint64_t> bytes;
+    std::ifstream in(only("wrapper_profile.*.txt"));
+    std::string line;
+    bool total{false};
+    bool volume{false};
+    while (std::getline(in, line)) {
+        if (line.compare(0, 6, "Total ") == 0) {
+            total = true;
+            continue;
+        }
+        if (total && line.find("Bytes/call") != std::string::npos) {
+            volume = true;
+            continue;
+        }
+        if (!volume) {
+            continue;
+        }
+        if (line.empty()) {
+            break;
+        }
+        unsigned long long count;
+        double perCall, rate;
+        int name{0};
+        if (sscanf(line.c_str(), "%llu %lf %lf %n", &count, &perCall, &rate, &name) == 3 && name > 0) {
+            bytes[line.substr(name)] += count;
+        }
+    }
+    return bytes;
+}
+
+typedef struct event {
+    uint64_t count;
+    double max;
+    double total;
+} event_t;
+
+/* The samples of each event, from the total of the builtin profile */
+static std::map<std::string, event_t> totalEvents() {
+    std::map<std::string, event_t> events;
+    std::ifstream in(only("wrapper_profile.*.txt"));
+    std::string line;
+    bool total{false};
+    bool samples{false};
+    while (std::getline(in, line)) {
+        if (line.compare(0, 6, "Total ") == 0) {
+            total = true;
+            continue;
+        }
+        if (total && line.find("#Samples") != std::string::npos) {
+            samples = true;
+            continue;
+        }
+        if (!samples) {
+            continue;
+        }
+        if (line.empty()) {
+            break;
+        }
+        unsigned long long count;
+        double mean, min, max, sum;
+        int name{0};
+        if (sscanf(line.c_str(), "%llu %lf %lf %lf %lf %n", &count, &mean, &min,
+                &max, &sum, &name) == 5 && name > 0) {
+            events[line.substr(name)] = event_t{count, max, sum};
+        }
+    }
+    return events;
+}
+
+/* The calls from each call site of each method, and where it is */
+static std::map<std::string, std::map<std::string, uint64_t>> callSites() {
+    std::map<std::string, std::map<std::string, uint64_t>> sites;
+    std::ifstream in(only("wrapper_callsites.*.txt"));
+    std::string line;
+    std::string method;
+    while (std::getline(in, line)) {
+        unsigned long long count;
+        int where{0};
+        if (line.empty()) {
+            method.clear();
+        } else if (method.empty()) {
+            method = line.substr(0, line.size() - 1); // without the ':'
+        } else if (sscanf(line.c_str(), "%llu %n", &count, &where) == 1 && where > 0) {
+            sites[method][line.substr(where)] += count;
+        }
+    }
+    return sites;
+}
+
+/* The one call site of the method, called from the program */
+static void checkCallSite(const std::string& method, const std::string& program,
+        uint64_t calls) {
+    auto sites = callSites();
+    check(sites.size() == 1 && sites[method].size() == 1, "one call site of " + method);
+    auto& site = *sites[method].begin();
+    check(site.second == calls, "the calls from the call site of " + method);
+    check(site.first.find("/" + program + "+0x") != std::string::npos,
+        "the call site in " + program);
+}
+
+typedef struct latency {
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+} latency_t;
+
+/* The latency of the method, from the histograms written to the file */
+static latency_t latencyOf(const std::string& filename, const std::string& method) {
+    latency_t l{0, 0, 0, 0, 0};
+    std::ifstream in(filename);
+    std::string line;
+    const std::string name{"{\"name\": \"" + method + "\", "};
+    while (std::getline(in, line)) {
+        size_t found = line.find(name);
+        if (found == std::string::npos) {
+            continue;
+        }
+        unsigned long long count, p50, p99, p999, max;
+        double mean;
+        if (sscanf(line.c_str() + found + name.size(), "\"count\": %llu, \"mean\": %lf, "
+                "\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}",
+                &count, &mean, &p50, &p99, &p999, &max) == 6) {
+            l = latency_t{count, p50, p99, p999, max};
+        }
+    }
+    check(l.count > 0, "the latency of " + method + " in " + filename);
+    check(l.p50 <= l.p99 && l.p99 <= l.p999 && l.p999 <= l.max,
+        "the latency percentiles of " + method + " in order");
+    return l;
+}
+
+/* Each method app.cpp calls once.  The wrappers for the constructor and
+ * destructor of Secret are a constructor and destructor themselves, so they
+ * also construct and destroy its InnerClass, unless the wrappers are plain
+ * functions (linked into app, or attached), when only the calls from app
+ * itself are wrapped.  Generated from profile_check.txt, foo1 isn't
+ * wrapped, and getMessage() is only counted. */
+static void checkApp(bool flat, bool profiled) {
+    std::map<std::string, uint64_t> calls{totalCalls()};
+    const char * called[] = {
+        "[WRAPPER] secret::Secret::Secret()",
+        "[WRAPPER] secret::Secret::~Secret()",
+        "[WRAPPER] secret::Secret::InnerClass::InnerClass()",
+        "[WRAPPER] secret::Secret::InnerClass::~InnerClass()",
+        "[WRAPPER] std::string secret::Secret::getMessage() const",
+        "[WRAPPER] int secret::Secret::foo1(secret::Dim a)",
+        "[WRAPPER] void secret::Secret::foo2(secret::Dim b, secret::Dim c)",
+        "[WRAPPER] void secret::Secret::foo3(std::string name)",
+        "[WRAPPER] int secret::Variable<int, void>::Data() const",
+        "[WRAPPER] void secret::Secret::foo4<int, void>(Variable<int, void> a)",
+        "[WRAPPER] void secret::Secret::foo4<double, void>(Variable<double, void> a)",
+        "[WRAPPER] void secret::Secret::foo4<float, void>(Variable<float, void> a)",
+        "[WRAPPER] void secret::Variable<float, void>::anotherTemplate<int>(int a)"
+    };
+    size_t timers{0};
+    for (auto name : called) {
+        if (flat && std::string(name).find("InnerClass") != std::string::npos) {
+            continue;
+        }
+        if (profiled && std::string(name).find("foo1") != std::string::npos) {
+            continue;
+        }
+        check(calls.count(name) > 0 && calls[name] == 1, std::string("one call to ") + name);
+        timers++;
+    }
+    check(calls.size() == timers, "no other timers");
+}
+
+/* The calls early.cpp makes before the wrapper is initialized */
+static void checkEarly() {
+    std::map<std::string, uint64_t> calls{totalCalls()};
+    check(calls["[WRAPPER] int secret::Secret::foo1(secret::Dim a)"] == 1,
+        "one call to foo1 before the wrapper is initialized");
+}
+
+/* The calls attach.cpp makes while the wrapper is attached */
+static void checkAttach() {
+    std::map<std::string, uint64_t> calls{totalCalls()};
+    check(calls["[WRAPPER] int secret::Secret::foo1(secret::Dim a)"] == 2,
+        "two calls to foo1 while attached");
+    check(calls.size() == 1, "no other timers while attached");
+}
+
+/* Nothing at all, with no methods wrapped */
+static void checkNothing() {
+    glob_t found;
+    check(glob("wrapper_profile.*.txt", 0, nullptr, &found) == GLOB_NOMATCH,
+        "no profile without wrappers");
+    globfree(&found);
+}
+
+/* Regenerated from the profile of the run with the wrapper generated from
+ * profile_check.txt, foo1 and getMessage() keep what they got.  What the
+ * other methods get depends on how long they took. */
+static void checkRegenerated() {
+    std::map<std::string, uint64_t> calls{totalCalls()};
+    check(calls.count("[WRAPPER] int secret::Secret::foo1(secret::Dim a)") == 0,
+        "foo1 still not wrapped");
+    check(calls["[WRAPPER] std::string secret::Secret::getMessage() const"] == 1,
+        "getMessage() still counted");
+}
+
+/* What app.cpp calls, with the wrapper generated from config_features.json */
+static void checkFeatures() {
+    std::map<std::string, uint64_t> calls{totalCalls()};
+    // the objects are numbered in the order they are first seen
+    check(calls["[WRAPPER] int secret::Variable<int, void>::Data() const [instance 1]"] == 1,
+        "one call to Data() of the first Variable");
+    check(calls["[WRAPPER] void secret::Variable<float, void>::anotherTemplate<int>(int a) [instance 2]"] == 1,
+        "one call to anotherTemplate() of the second Variable");
+    std::map<std::string, uint64_t> bytes{totalBytes()};
+    check(bytes["[WRAPPER] void secret::Secret::foo3(std::string name)"] == 5,
+        "the bytes of the name given to foo3");
+    check(bytes["[WRAPPER] void secret::Secret::foo4<int, void>(Variable<int, void> a)"] == sizeof(int),
+        "the bytes of the overload of foo4 given by its signature");
+    check(bytes.size() == 2, "no bytes for the other methods");
+    // foo3 and foo4<int> are queued up on the object, foo4<float> flushes them
+    std::map<std::string, event_t> events{totalEvents()};
+    const std::string flush{"[WRAPPER] void secret::Secret::foo4<float, void>(Variable<float, void> a)"};
+    event_t depth{events[flush + " : Queue depth"]};
+    check(depth.count == 1 && depth.max == 2.0, "two operations flushed at once");
+    event_t latency{events[flush + " : Enqueue to flush latency (us)"]};
+    check(latency.count == 2 && latency.max > 0.0, "the latency of each operation");
+    event_t flushed{events[flush + " : Bytes flushed"]};
+    check(flushed.count == 1 && flushed.total == 5 + sizeof(int), "the bytes of both operations");
+    check(events.size() == 3, "no other events");
+    // foo1 and foo2 are timed by the value of an argument
+    check(calls["[WRAPPER] int secret::Secret::foo1(secret::Dim a) [1]"] == 1,
+        "one call to foo1 with 1");
+    check(calls["[WRAPPER] void secret::Secret::foo2(secret::Dim b, secret::Dim c) [1]"] == 1,
+        "one call to foo2 with 1");
+    checkCallSite("[WRAPPER] void secret::Secret::foo2(secret::Dim b, secret::Dim c)", "app", 1);
+    latency_t foo2{latencyOf(only("wrapper_latency.*.json"),
+        "[WRAPPER] void secret::Secret::foo2(secret::Dim b, secret::Dim c)")};
+    check(foo2.count == 1 && foo2.p50 == foo2.max, "the latency of one call to foo2");
+}
+
+/* What threads.cpp calls, with the same wrapper */
+static void checkThreads() {
+    std::map<std::string, uint64_t> calls{totalCalls()};
+    const std::string data{"[WRAPPER] int secret::Variable<int, void>::Data() const"};
+    bool ok{true};
+    for (int i = 1 ; i <= 64 ; i++) {
+        ok = ok && calls[data + " [instance " + std::to_string(i) + "]"] == 8;
+    }
+    check(ok, "one id for each object seen by all the threads at once");
+    check(calls[data + " [instance overflow]"] == 16 * 8, "the objects after the limit");
+    // each value is seen first in round 0 to 7
+    const std::string foo2{"[WRAPPER] void secret::Secret::foo2(secret::Dim b, secret::Dim c)"};
+    ok = true;
+    for (int i = 0 ; i < 4 ; i++) {
+        ok = ok && calls[foo2 + " [" + std::to_string(i) + "]"] == 10 * 8;
+    }
+    check(ok, "one timer for each value seen by all the threads at once");
+    check(calls[foo2 + " [other values]"] == 4 * 10 * 8, "the values after the limit");
+    check(calls.size() == 65 + 5, "no other timers");
+    checkCallSite(foo2, "threads", 80 * 8);
+    // all the calls were made before the snapshot
+    check(latencyOf(only("wrapper_latency.*.json"), foo2).count == 80 * 8,
+        "the latency of each call to foo2");
+    check(latencyOf("wrapper_latency_snapshot.json", foo2).count == 80 * 8,
+        "the latency of each call to foo2 in the snapshot");
+}
+
+int main(int argc, char **argv) {
+    std::string run{argc == 2 ? argv[1] : ""};
+    if (run == "app" || run == "link" || run == "got" || run == "profiled") {
+        checkApp(run != "app", run == "profiled");
+    } else if (run == "regenerated") {
+        checkRegenerated();
+    } else if (run == "features") {
+        checkFeatures();
+    } else if (run == "threads") {
+        checkThreads();
+    } else if (run == "early") {
+        checkEarly();
+    } else if (run == "attach") {
+        checkAttach();
+    } else if (run == "nothing") {
+        checkNothing();
+    } else {
+        std::cerr << "Usage: " << argv[0] << " app|link|got|profiled|regenerated|features|threads|early|attach|nothing" << std::endl;
+        return 1;
+    }
+    if (failures > 0) {
+        std::cerr << failures << " checks failed." << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,17 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ***************************************************************************/
+
+/* A library that calls the secret library from its constructor, which
+ * runs before the constructors of a wrapper preloaded ahead of it. */
+
+#include <secret.h>
+
+__attribute__((constructor)) static void callEarly() {
+    secret::Secret object;
+    object.foo1(3);
+}
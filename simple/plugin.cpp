@@ -0,0 +1,16 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ***************************************************************************/
+
+/* A library that calls the secret library, opened by attach.cpp after the
+ * wrapper attached. */
+
+#include <secret.h>
+
+extern "C" int callFoo1(secret::Secret& object, int x) {
+    return object.foo1(x);
+}
@@ -0,0 +1,61 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ***************************************************************************/
+
+/* Calls the same methods of the same new objects, and with the same new
+ * values, from all the threads at once, so that the wrappers see each of
+ * them for the first time in more than one thread. */
+
+#include <stdio.h>
+#include <dlfcn.h>
+#include <secret.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace secret;
+
+const int numThreads{8};
+// more than the "instance limit"
+const int numObjects{80};
+// more than the "timer argument limit"
+const int numValues{8};
+
+static std::atomic<int> arrived{0};
+
+/* Wait for all the threads to get to the same round */
+static void barrier(int round) {
+    arrived++;
+    while (arrived.load() < (round + 1) * numThreads) {
+        std::this_thread::yield();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<Variable<int, void>> objects(numObjects);
+    std::vector<std::thread> threads;
+    for (int t = 0 ; t < numThreads ; t++) {
+        threads.push_back(std::thread([&]() {
+            for (int i = 0 ; i < numObjects ; i++) {
+                barrier(i);
+                objects[i].Data();
+                Secret::foo2(0, i % numValues);
+            }
+        }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    // with the latency histograms, write them now as well as at exit
+    typedef int (*snapshot_t)(const char *);
+    snapshot_t snapshot = (snapshot_t)dlsym(RTLD_DEFAULT, "tau_wrap_latency_snapshot");
+    if (snapshot != nullptr) {
+        snapshot("wrapper_latency_snapshot.json");
+    }
+    return 0;
+}
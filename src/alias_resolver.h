@@ -0,0 +1,173 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ****************************************************************************/
+
+/* Expands "using" aliases in type spellings.  The aliases are recorded
+ * with the scope they were declared in while the header is traversed,
+ * and once the traversal is done, aliases used in other aliases are
+ * expanded.  After that, a type is rewritten in one pass: every
+ * (possibly qualified) name in the type is looked up the way the compiler
+ * would, from the innermost scope outwards, and replaced if it is an
+ * alias.  The results are cached per scope and type spelling, so each
+ * spelling is only rewritten once. */
+
+#pragma once
+
+#include <stdint.h>
+#include <ctype.h>
+#include <string>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include "string_table.h"
+
+class AliasResolver {
+public:
+    AliasResolver(StringTable& names) : _names(names) {}
+    /* "using alias = expansion;" was declared in scope */
+    void add(stringId_t scope, const std::string& alias,
+        const std::string& expansion) {
+        std::string key{qualified(_names.str(scope), alias)};
+        // the first declaration wins
+        if (_aliases.count(key) == 0) {
+            _aliases[key] = expansion;
+            _scopes[key] = _names.str(scope);
+        }
+    }
+    /* Expand the aliases used by other aliases.  Call once, after parsing. */
+    void build() {
+        for (size_t pass = 0 ; pass < maxDepth ; pass++) {
+            bool changed{false};
+            for (auto& alias : _aliases) {
+                std::string expanded{rewrite(_scopes[alias.first], alias.second)};
+                if (expanded != alias.second) {
+                    alias.second = expanded;
+                    changed = true;
+                }
+            }
+            if (!changed) {
+                break;
+            }
+        }
+    }
+    /* The type, as seen from scope, with all the aliases expanded */
+    stringId_t resolve(stringId_t scope, stringId_t type) {
+        uint64_t key = ((uint64_t)scope << 32) | type;
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            auto found = _cache.find(key);
+            if (found != _cache.end()) {
+                return found->second;
+            }
+        }
+        // the aliases don't change after build(), no lock needed
+        stringId_t result{_names.intern(
+            rewrite(_names.str(scope), _names.str(type)))};
+        std::lock_guard<std::mutex> guard(_lock);
+        _cache[key] = result;
+        return result;
+    }
+    size_t size() { return _aliases.size(); }
+private:
+    // deeper than any sane chain of aliases, stops cycles
+    static const size_t maxDepth = 16;
+    StringTable& _names;
+    // fully qualified alias name to expansion, and declaring scope
+    std::map<std::string, std::string> _aliases;
+    std::map<std::string, std::string> _scopes;
+    std::unordered_map<uint64_t, stringId_t> _cache;
+    std::mutex _lock;
+
+    static std::string qualified(const std::string& scope, const std::string& name) {
+        if (scope.size() == 0) {
+            return name;
+        }
+        return scope + "::" + name;
+    }
+    static bool isIdentifierStart(char c) {
+        return isalpha((unsigned char)c) || c == '_';
+    }
+    static bool isIdentifier(char c) {
+        return isalnum((unsigned char)c) || c == '_';
+    }
+    /* Look the name up from the scope outwards */
+    bool lookup(const std::string& scope, const std::string& name,
+        std::string& expansion) {
+        if (name.compare(0, 2, "::") == 0) {
+            auto found = _aliases.find(name.substr(2));
+            if (found == _aliases.end()) {
+                return false;
+            }
+            expansion = found->second;
+            return true;
+        }
+        std::string current{scope};
+        while (true) {
+            auto found = _aliases.find(qualified(current, name));
+            if (found != _aliases.end()) {
+                expansion = found->second;
+                return true;
+            }
+            if (current.size() == 0) {
+                return false;
+            }
+            size_t i = current.rfind("::");
+            current = (i == std::string::npos) ? "" : current.substr(0, i);
+        }
+    }
+    /* One pass over the type, replacing each name that is an alias */
+    std::string rewrite(const std::string& scope, const std::string& type) {
+        std::string result;
+        result.reserve(type.size());
+        size_t n = type.size();
+        size_t i = 0;
+        while (i < n) {
+            bool afterIdentifier = (i > 0 && isIdentifier(type[i-1]));
+            // "::name", but not "Foo<T>::name"
+            bool global = (type.compare(i, 2, "::") == 0 && i + 2 < n &&
+                           isIdentifierStart(type[i+2]) &&
+                           !(i > 0 && type[i-1] == '>'));
+            // "Foo<T>::name" is a member of Foo<T>, leave it alone
+            bool member = (i >= 2 && type.compare(i-2, 2, "::") == 0);
+            if (afterIdentifier || member ||
+                !(isIdentifierStart(type[i]) || global)) {
+                result += type[i];
+                i++;
+                continue;
+            }
+            // read a qualified name: [::]a::b::c
+            size_t start = i;
+            if (global) {
+                i += 2;
+            }
+            while (true) {
+                while (i < n && isIdentifier(type[i])) {
+                    i++;
+                }
+                if (type.compare(i, 2, "::") == 0 && i + 2 < n &&
+                    isIdentifierStart(type[i+2])) {
+                    i += 2;
+                    continue;
+                }
+                break;
+            }
+            std::string name{type.substr(start, i - start)};
+            if (name == "typename" && i < n && type[i] == ' ') {
+                // drop "typename ", it's not in the demangled names
+                i++;
+                continue;
+            }
+            std::string expansion;
+            if (lookup(scope, name, expansion)) {
+                result += expansion;
+            } else {
+                result += name;
+            }
+        }
+        return result;
+    }
+};
@@ -0,0 +1,108 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ****************************************************************************/
+
+/* Optimal assignment of declarations to symbols (the Hungarian method).
+ * Given a matrix of costs, with a row per declaration and a column per
+ * candidate symbol, find the assignment of rows to distinct columns with
+ * the smallest total cost.  Pairs that can't be matched have the cost
+ * noAssignment, and rows are never assigned to those. */
+
+#pragma once
+
+#include <limits.h>
+#include <vector>
+#include <algorithm>
+
+const int noAssignment = INT_MAX;
+
+/* Returns the column assigned to each row, or -1 if none */
+inline std::vector<int> solveAssignment(const std::vector<std::vector<int>>& cost) {
+    size_t rows = cost.size();
+    size_t cols = rows > 0 ? cost[0].size() : 0;
+    std::vector<int> result(rows, -1);
+    if (rows == 0 || cols == 0) {
+        return result;
+    }
+    // the easy (and common) case: one declaration, take the first best
+    if (rows == 1) {
+        int best = noAssignment;
+        for (size_t c = 0 ; c < cols ; c++) {
+            if (cost[0][c] < best) {
+                best = cost[0][c];
+                result[0] = (int)c;
+            }
+        }
+        return result;
+    }
+    // square it off, unmatchable pairs cost more than any real assignment
+    size_t n = std::max(rows, cols);
+    long long big = 1;
+    for (auto& row : cost) {
+        for (auto c : row) {
+            if (c != noAssignment) {
+                big += c;
+            }
+        }
+    }
+    auto at = [&](size_t r, size_t c) -> long long {
+        if (r >= rows || c >= cols || cost[r][c] == noAssignment) {
+            return (r >= rows || c >= cols) ? 0 : big;
+        }
+        return cost[r][c];
+    };
+    // potentials and matching, 1-based with a dummy column 0
+    std::vector<long long> u(n + 1, 0), v(n + 1, 0);
+    std::vector<size_t> p(n + 1, 0), way(n + 1, 0);
+    for (size_t i = 1 ; i <= n ; i++) {
+        p[0] = i;
+        size_t j0 = 0;
+        std::vector<long long> minv(n + 1, LLONG_MAX);
+        std::vector<bool> used(n + 1, false);
+        do {
+            used[j0] = true;
+            size_t i0 = p[j0];
+            size_t j1 = 0;
+            long long delta = LLONG_MAX;
+            for (size_t j = 1 ; j <= n ; j++) {
+                if (!used[j]) {
+                    long long cur = at(i0 - 1, j - 1) - u[i0] - v[j];
+                    if (cur < minv[j]) {
+                        minv[j] = cur;
+                        way[j] = j0;
+                    }
+                    if (minv[j] < delta) {
+                        delta = minv[j];
+                        j1 = j;
+                    }
+                }
+            }
+            for (size_t j = 0 ; j <= n ; j++) {
+                if (used[j]) {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                } else {
+                    minv[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (p[j0] != 0);
+        do {
+            size_t j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+    for (size_t j = 1 ; j <= n ; j++) {
+        size_t r = p[j] - 1;
+        size_t c = j - 1;
+        if (p[j] != 0 && r < rows && c < cols && cost[r][c] != noAssignment) {
+            result[r] = (int)c;
+        }
+    }
+    return result;
+}
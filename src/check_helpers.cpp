@@ -0,0 +1,166 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ***************************************************************************/
+
+/* Checks the helpers that are easy to get subtly wrong.  They are all
+ * header only, so this needs neither libclang nor TAU.  wrap_latency.h is
+ * the latency histograms from wrapper_runtime.h (see the Makefile). */
+
+#include <stdio.h>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include "assignment.h"
+#include "profile_reader.h"
+#include "wrap_latency.h"
+
+static int failures{0};
+
+static void check(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+static void checkAssignment() {
+    const int x = noAssignment;
+    // the greedy choice (row 0 takes column 0) isn't the best one
+    std::vector<int> result{solveAssignment({{1, 2}, {1, 5}})};
+    check(result == std::vector<int>({1, 0}), "the cheapest assignment");
+    // a row that can't be matched is left out
+    result = solveAssignment({{x, x}, {3, 1}, {2, x}});
+    check(result == std::vector<int>({-1, 1, 0}), "an unmatchable row");
+    // more rows than columns
+    result = solveAssignment({{4}, {2}, {3}});
+    check(result == std::vector<int>({-1, 0, -1}), "more rows than columns");
+    // more columns than rows
+    result = solveAssignment({{3, 1, 2}, {1, 1, 4}});
+    check(result == std::vector<int>({1, 0}), "more columns than rows");
+}
+
+/* Per-instance and throttled timers, and the calls counted without a
+ * timer, are all added to the timer of the method */
+static void checkTauProfile() {
+    const char * filename = "profile.check";
+    std::ofstream out(filename);
+    out << "3 templated_functions_MULTI_TIME\n"
+        << "# Name Calls Subrs Excl Incl ProfileCalls #\n"
+        << "\".TAU application\" 1 3 100 400 0 GROUP=\"TAU_DEFAULT\"\n"
+        << "\"[WRAPPER] int secret::Secret::foo1(secret::Dim a) [THROTTLED]\" "
+        << "7 0 300 300 0 GROUP=\"SECRET\"\n"
+        << "\"[WRAPPER] void secret::Secret::foo3(std::string name) [instance 2]\" "
+        << "3 0 30 30 0 GROUP=\"SECRET\"\n"
+        << "0 aggregates\n"
+        << "2 userevents\n"
+        << "# eventname numevents max min mean sumsqr\n"
+        << "\"[WRAPPER] std::string secret::Secret::getMessage() const\" 5 1 1 1 5\n"
+        << "\"[WRAPPER] void secret::Secret::foo3(std::string name) : Bytes\" 3 1 1 1 3\n";
+    out.close();
+    profile_t profile;
+    check(ProfileReader(profile).read(filename), "reading a TAU profile");
+    profileEntry_t& foo1 = profile["[WRAPPER] int secret::Secret::foo1(secret::Dim a)"];
+    check(foo1.calls == 7 && foo1.inclusive == 300.0, "a throttled TAU timer");
+    profileEntry_t& foo3 = profile["[WRAPPER] void secret::Secret::foo3(std::string name)"];
+    check(foo3.calls == 3 && foo3.inclusive == 30.0, "a per-instance TAU timer");
+    profileEntry_t& counted = profile["[WRAPPER] std::string secret::Secret::getMessage() const"];
+    check(counted.calls == 5 && counted.inclusive == 0.0, "a TAU counter");
+    check(profile.size() == 4, "the counters, but not the other events");
+    remove(filename);
+}
+
+/* Only the total is read, in microseconds */
+static void checkBuiltinProfile() {
+    const char * filename = "wrapper_profile.check.txt";
+    std::ofstream out(filename);
+    out << "Thread 0:\n"
+        << " %Time   Exclusive ms   Inclusive ms        #Call    usec/call  Name\n"
+        << "  60.0          0.030          0.030            2       15.000  [WRAPPER] int secret::Secret::foo1(secret::Dim a) [1]\n"
+        << "\n"
+        << "Total (1 threads):\n"
+        << " %Time   Exclusive ms   Inclusive ms        #Call    usec/call  Name\n"
+        << "  60.0          0.030          0.030            2       15.000  [WRAPPER] int secret::Secret::foo1(secret::Dim a) [1]\n"
+        << "  40.0          0.020          0.020            1       20.000  [WRAPPER] int secret::Secret::foo1(secret::Dim a) [other]\n"
+        << "\n";
+    out.close();
+    profile_t profile;
+    check(ProfileReader(profile).read(filename), "reading a builtin profile");
+    profileEntry_t& foo1 = profile["[WRAPPER] int secret::Secret::foo1(secret::Dim a)"];
+    check(foo1.calls == 3 && foo1.inclusive == 50.0, "the per-value builtin timers");
+    check(profile.size() == 1, "only the total of the builtin profile");
+    remove(filename);
+}
+
+/* Each value is in the bucket from just above the highest value of the one
+ * before it to the highest value of its own, which is within 1/32 of it */
+static void checkLatencyBuckets() {
+    std::vector<uint64_t> values;
+    for (uint64_t ns = 0 ; ns < 100000 ; ns++) {
+        values.push_back(ns);
+    }
+    for (int bits = 17 ; bits < 48 ; bits++) {
+        for (uint64_t ns : {(1ULL << bits) - 1, 1ULL << bits, (1ULL << bits) + 1,
+                (3ULL << (bits - 1)) + 12345}) {
+            values.push_back(ns);
+        }
+    }
+    bool inside{true}, narrow{true}, ordered{true};
+    size_t previous{0};
+    for (auto ns : values) {
+        size_t i = wrap_latency::bucket(ns);
+        uint64_t highest = wrap_latency::highest(i);
+        inside = inside && ns <= highest && (i == 0 || ns > wrap_latency::highest(i - 1));
+        narrow = narrow && (highest - ns) * 32 <= ns;
+        ordered = ordered && i >= previous;
+        previous = i;
+    }
+    check(inside, "the latency bucket of each value");
+    check(narrow, "the width of the latency buckets");
+    check(ordered, "the order of the latency buckets");
+    check(wrap_latency::bucket(1ULL << 50) == wrap_latency::bucket_count - 1,
+        "the longest latencies in the last bucket");
+}
+
+/* The percentiles are the highest value of their buckets, but not more than
+ * the maximum */
+static void checkLatencyPercentiles() {
+    // the histograms are written at exit, by a handler that this one runs after
+    atexit([]() {
+        remove(("wrapper_latency." + std::to_string(getpid()) + ".json").c_str());
+    });
+    wrap_latency::histogram histogram("check");
+    for (uint64_t ns = 1 ; ns <= 1000 ; ns++) {
+        histogram.record(ns);
+    }
+    FILE * out = tmpfile();
+    histogram.write(out, true);
+    rewind(out);
+    unsigned long long count, p50, p99, p999, max;
+    double mean;
+    int read = fscanf(out, " {\"name\": \"check\", \"count\": %llu, \"mean\": %lf, "
+        "\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}",
+        &count, &mean, &p50, &p99, &p999, &max);
+    fclose(out);
+    check(read == 6, "reading the latency histogram");
+    check(count == 1000 && mean == 500.5 && max == 1000, "the latency count, mean and max");
+    // 500 is in 496-503, 990 in 976-991, and 999 in 992-1007
+    check(p50 == 503 && p99 == 991 && p999 == 1000, "the latency percentiles");
+}
+
+int main() {
+    checkAssignment();
+    checkTauProfile();
+    checkBuiltinProfile();
+    checkLatencyBuckets();
+    checkLatencyPercentiles();
+    if (failures > 0) {
+        std::cerr << failures << " checks failed." << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,116 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ****************************************************************************/
+
+/* Self-profiling for the generator.  The main phases are timed one after
+ * the other, and the memory high-water mark is sampled at the end of each
+ * one.  Work done inside a phase (like demangling while reading the
+ * symbols) can be accumulated separately, and the counters can be
+ * incremented from any thread. */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <iostream>
+
+class PhaseTimer {
+public:
+    PhaseTimer() : _inPhase(false), _firstPart(0) {}
+    /* start timing a phase, ending the previous one */
+    void begin(const std::string& name) {
+        end();
+        _name = name;
+        _start = std::chrono::steady_clock::now();
+        _inPhase = true;
+        std::lock_guard<std::mutex> guard(_lock);
+        _firstPart = _phases.size();
+    }
+    void end() {
+        if (!_inPhase) {
+            return;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - _start;
+        _inPhase = false;
+        // listed before the parts of it that were accumulated
+        std::lock_guard<std::mutex> guard(_lock);
+        phase_t p{_name, elapsed.count(), maxrss(), false};
+        _phases.insert(_phases.begin() + _firstPart, p);
+    }
+    /* time spent on part of the current phase, from any thread */
+    void accumulate(const std::string& name, double seconds) {
+        add(name, seconds, true);
+    }
+    /* the counters */
+    std::atomic<uint64_t> symbols{0};
+    std::atomic<uint64_t> cursors{0};
+    std::atomic<uint64_t> declarations{0};
+    std::atomic<uint64_t> permutations{0};
+    std::atomic<uint64_t> alignments{0};
+    std::atomic<uint64_t> cells{0};
+    std::atomic<uint64_t> wrappers{0};
+    void report(std::ostream& out) {
+        end();
+        char line[256];
+        snprintf(line, sizeof(line), "%-28s %12s %14s\n", "Phase", "Seconds", "Max RSS (MB)");
+        out << line;
+        double total{0.0};
+        for (auto& p : _phases) {
+            if (p.part) {
+                snprintf(line, sizeof(line), "  %-26s %12.3f %14s\n",
+                    p.name.c_str(), p.seconds, "");
+            } else {
+                total += p.seconds;
+                snprintf(line, sizeof(line), "%-28s %12.3f %14.1f\n",
+                    p.name.c_str(), p.seconds, p.maxrss / 1024.0);
+            }
+            out << line;
+        }
+        snprintf(line, sizeof(line), "%-28s %12.3f %14.1f\n", "total", total, maxrss() / 1024.0);
+        out << line;
+        out << "Symbols: " << symbols << ", cursors: " << cursors
+            << ", declarations: " << declarations << ", permutations: "
+            << permutations << ", alignment calls: " << alignments
+            << ", DP cells: " << cells << ", wrappers: " << wrappers
+            << std::endl;
+    }
+private:
+    typedef struct phase {
+        std::string name;
+        double seconds;
+        long maxrss; // KB
+        bool part;
+    } phase_t;
+    std::vector<phase_t> _phases;
+    std::string _name;
+    std::chrono::steady_clock::time_point _start;
+    bool _inPhase;
+    size_t _firstPart;
+    std::mutex _lock;
+    static long maxrss() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+    void add(const std::string& name, double seconds, bool part) {
+        std::lock_guard<std::mutex> guard(_lock);
+        for (size_t i = _firstPart ; i < _phases.size() ; i++) {
+            if (_phases[i].name == name && _phases[i].part == part) {
+                _phases[i].seconds += seconds;
+                return;
+            }
+        }
+        phase_t p{name, seconds, 0, part};
+        _phases.push_back(p);
+    }
+};
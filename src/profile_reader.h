@@ -0,0 +1,138 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ****************************************************************************/
+
+/* Reads the call counts and inclusive times of the timers from a previous
+ * run, for profile guided generation.  Both TAU profiles (profile.n.c.t,
+ * one per thread) and the flat profiles written by the builtin profiler
+ * (wrapper_profile.<pid>.txt, where only the total over all threads is
+ * read) are understood.  Reading more than one file adds them up.  The
+ * per-instance and per-value timers ("[WRAPPER] <signature> [<label>]")
+ * are added to the timer of their method, and the calls counted by the
+ * wrappers that only count (user events, with TAU) have no time. */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+typedef struct profileEntry {
+    uint64_t calls;
+    // in microseconds
+    double inclusive;
+} profileEntry_t;
+
+typedef std::unordered_map<std::string, profileEntry_t> profile_t;
+
+class ProfileReader {
+public:
+    ProfileReader(profile_t& profile) : _profile(profile) {}
+    /* Returns false if the file can't be read, or isn't a profile */
+    bool read(const std::string& filename) {
+        std::ifstream in(filename);
+        std::string line;
+        if (!in.good() || !std::getline(in, line)) {
+            return false;
+        }
+        if (line.find("templated_functions") != std::string::npos) {
+            return readTau(in, atoi(line.c_str()));
+        }
+        return readBuiltin(in);
+    }
+private:
+    profile_t& _profile;
+    void add(std::string name, uint64_t calls, double inclusive) {
+        // throttled timers are still the same timer
+        const std::string throttled{" [THROTTLED]"};
+        size_t pos = name.find(throttled);
+        if (pos != std::string::npos) {
+            name.erase(pos, throttled.size());
+        }
+        // signatures don't have " [", so that's where the label starts
+        const std::string wrapper{"[WRAPPER] "};
+        if (name.compare(0, wrapper.size(), wrapper) == 0) {
+            pos = name.find(" [", wrapper.size());
+            if (pos != std::string::npos) {
+                name.erase(pos);
+            }
+        }
+        profileEntry_t& entry = _profile[name];
+        entry.calls += calls;
+        entry.inclusive += inclusive;
+    }
+    /* Where the quoted name at the start of the line ends, or 0 */
+    static size_t nameEnd(const std::string& line) {
+        size_t close = line.find("\" ", 1);
+        if (line.size() == 0 || line[0] != '"' || close == std::string::npos) {
+            return 0;
+        }
+        return close;
+    }
+    /* "name" calls subroutines exclusive inclusive profilecalls GROUP="group"
+     * then "n aggregates", and "n userevents" with the column names and
+     * "name" numevents max min mean sumsqr */
+    bool readTau(std::ifstream& in, int count) {
+        std::string line;
+        // the column names
+        std::getline(in, line);
+        for (int i = 0 ; i < count && std::getline(in, line) ; i++) {
+            size_t close = nameEnd(line);
+            double calls, subroutines, exclusive, inclusive;
+            if (close > 0 && sscanf(line.c_str() + close + 1, "%lf %lf %lf %lf",
+                &calls, &subroutines, &exclusive, &inclusive) == 4) {
+                add(line.substr(1, close - 1), (uint64_t)calls, inclusive);
+            }
+        }
+        int aggregates{0}, events{0};
+        if (!std::getline(in, line) || sscanf(line.c_str(), "%d aggregates", &aggregates) != 1) {
+            return true;
+        }
+        for (int i = 0 ; i < aggregates && std::getline(in, line) ; i++) {}
+        if (!std::getline(in, line) || sscanf(line.c_str(), "%d userevents", &events) != 1) {
+            return true;
+        }
+        // the column names
+        std::getline(in, line);
+        for (int i = 0 ; i < events && std::getline(in, line) ; i++) {
+            size_t close = nameEnd(line);
+            double numevents;
+            if (close == 0 || sscanf(line.c_str() + close + 1, "%lf", &numevents) != 1) {
+                continue;
+            }
+            // the calls counted by a wrapper, not the other events
+            std::string name{line.substr(1, close - 1)};
+            if (name.compare(0, 10, "[WRAPPER] ") == 0 && name.find(" : ") == std::string::npos) {
+                add(name, (uint64_t)numevents, 0.0);
+            }
+        }
+        return true;
+    }
+    /* %Time Exclusive-ms Inclusive-ms #Call usec/call Name, after "Total" */
+    bool readBuiltin(std::ifstream& in) {
+        std::string line;
+        while (std::getline(in, line) && line.compare(0, 5, "Total") != 0) {}
+        if (!in.good()) {
+            return false;
+        }
+        // the column names
+        std::getline(in, line);
+        while (std::getline(in, line) && line.size() > 0) {
+            double percent, exclusive, inclusive, perCall;
+            unsigned long long calls;
+            int name{0};
+            if (sscanf(line.c_str(), "%lf %lf %lf %llu %lf %n", &percent,
+                &exclusive, &inclusive, &calls, &perCall, &name) >= 5 && name > 0) {
+                add(line.substr(name), calls, inclusive * 1.0e3);
+            }
+        }
+        return true;
+    }
+};
@@ -0,0 +1,208 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ****************************************************************************/
+
+/* Whole-run result cache.  A fingerprint of all the inputs is computed
+ * (tool version, command line, configuration, library build-ids and the
+ * include closure of the header), and if it matches the fingerprint stored
+ * by a previous run the cached output files are restored, without parsing
+ * the header or matching any symbols.
+ *
+ * The include closure is only known after parsing, so the check is done in
+ * two steps: first everything except the closure is compared, then the
+ * files in the closure recorded by the previous run are hashed again. */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <elf.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "json.h"
+#include "wrapper_output.h"
+
+/* Bump this when the generated code changes in a way that the
+ * build-id of the tool doesn't capture. */
+const std::string tau_wrap_version{"tau_wrap++ 1.1"};
+
+/* Read the GNU build-id note from an ELF file, returns false if there
+ * isn't one (or it isn't a 64-bit ELF file). Only the headers and
+ * the note segments are read, not the whole library. */
+inline bool readBuildId(const std::string& filename, std::string& buildId) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool found{false};
+    Elf64_Ehdr ehdr;
+    if (pread(fd, &ehdr, sizeof(ehdr), 0) == (ssize_t)sizeof(ehdr) &&
+        memcmp(ehdr.e_ident, ELFMAG, SELFMAG) == 0 &&
+        ehdr.e_ident[EI_CLASS] == ELFCLASS64) {
+        for (size_t i = 0 ; i < ehdr.e_phnum && !found ; i++) {
+            Elf64_Phdr phdr;
+            off_t where = ehdr.e_phoff + i * ehdr.e_phentsize;
+            if (pread(fd, &phdr, sizeof(phdr), where) != (ssize_t)sizeof(phdr) ||
+                phdr.p_type != PT_NOTE || phdr.p_filesz > (1<<20)) {
+                continue;
+            }
+            std::vector<char> notes(phdr.p_filesz);
+            if (pread(fd, notes.data(), phdr.p_filesz, phdr.p_offset) !=
+                (ssize_t)phdr.p_filesz) {
+                continue;
+            }
+            // walk the notes in this segment
+            size_t offset = 0;
+            while (offset + sizeof(Elf64_Nhdr) <= notes.size()) {
+                Elf64_Nhdr* nhdr = (Elf64_Nhdr*)(notes.data() + offset);
+                size_t name = offset + sizeof(Elf64_Nhdr);
+                size_t desc = name + ((nhdr->n_namesz + 3) & ~3);
+                size_t next = desc + ((nhdr->n_descsz + 3) & ~3);
+                if (next > notes.size()) {
+                    break;
+                }
+                if (nhdr->n_type == NT_GNU_BUILD_ID &&
+                    nhdr->n_namesz == 4 &&
+                    memcmp(notes.data() + name, "GNU", 4) == 0) {
+                    std::stringstream ss;
+                    for (size_t j = 0 ; j < nhdr->n_descsz ; j++) {
+                        char tmp[3];
+                        snprintf(tmp, sizeof(tmp), "%02x",
+                            (unsigned char)notes[desc + j]);
+                        ss << tmp;
+                    }
+                    buildId = ss.str();
+                    found = true;
+                    break;
+                }
+                offset = next;
+            }
+        }
+    }
+    close(fd);
+    return found;
+}
+
+/* Identify a binary by build-id, or by content if it has no build-id */
+inline std::string binaryIdentity(const std::string& filename) {
+    std::string identity;
+    if (readBuildId(filename, identity)) {
+        return identity;
+    }
+    std::string contents;
+    if (readWholeFile(filename, contents)) {
+        return hashToString(contentHash(contents));
+    }
+    return "missing";
+}
+
+class ResultCache {
+public:
+    ResultCache(const std::string& directory) : _directory(directory) {}
+    /* Everything but the include closure goes into the input fingerprint */
+    void addInput(const std::string& name, const std::string& value) {
+        _inputs = contentHash(value, contentHash(name, _inputs));
+    }
+    void addBinary(const std::string& filename) {
+        addInput(filename, binaryIdentity(filename));
+    }
+    /* returns true if the outputs were restored from the cache */
+    bool restore();
+    void store(const std::vector<std::string>& closure,
+        const std::vector<std::string>& outputs);
+private:
+    std::string _directory;
+    uint64_t _inputs{14695981039346656037ULL};
+    std::string recordFile() { return _directory + "/fingerprint.json"; }
+    std::string cachedFile(const std::string& output) {
+        std::string name{output};
+        size_t i = name.rfind('/');
+        if (i != std::string::npos) {
+            name = name.substr(i+1);
+        }
+        return _directory + "/" + name;
+    }
+    bool closureHash(const std::vector<std::string>& closure, std::string& hash) {
+        uint64_t result{14695981039346656037ULL};
+        for (auto& filename : closure) {
+            std::string contents;
+            if (!readWholeFile(filename, contents)) {
+                return false;
+            }
+            result = contentHash(contents, contentHash(filename, result));
+        }
+        hash = hashToString(result);
+        return true;
+    }
+};
+
+inline bool ResultCache::restore() {
+    using json = nlohmann::json;
+    std::string tmp;
+    if (!readWholeFile(recordFile(), tmp)) {
+        return false;
+    }
+    json record;
+    try {
+        record = json::parse(tmp);
+        if (record["inputs"] != hashToString(_inputs)) {
+            return false;
+        }
+        std::vector<std::string> closure = record["closure"];
+        std::string hash;
+        if (!closureHash(closure, hash) || record["closure hash"] != hash) {
+            return false;
+        }
+        // read everything first, so a damaged cache doesn't half-restore
+        std::vector<std::string> outputs = record["outputs"];
+        std::vector<std::string> contents(outputs.size());
+        for (size_t i = 0 ; i < outputs.size() ; i++) {
+            if (!readWholeFile(cachedFile(outputs[i]), contents[i])) {
+                return false;
+            }
+        }
+        for (size_t i = 0 ; i < outputs.size() ; i++) {
+            writeIfChanged(outputs[i], contents[i]);
+        }
+    } catch (...) {
+        std::cerr << "Ignoring unreadable " << recordFile() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+inline void ResultCache::store(const std::vector<std::string>& closure,
+    const std::vector<std::string>& outputs) {
+    using json = nlohmann::json;
+    mkdir(_directory.c_str(), 0755);
+    // never leave a record pointing at outputs that are being replaced
+    std::remove(recordFile().c_str());
+    std::string hash;
+    if (!closureHash(closure, hash)) {
+        std::cerr << "Unable to read the include closure, not caching results." << std::endl;
+        return;
+    }
+    for (auto& output : outputs) {
+        std::string contents;
+        if (!readWholeFile(output, contents)) {
+            std::cerr << "Unable to read " << output << ", not caching results." << std::endl;
+            return;
+        }
+        writeIfChanged(cachedFile(output), contents);
+    }
+    json record;
+    record["inputs"] = hashToString(_inputs);
+    record["closure"] = closure;
+    record["closure hash"] = hash;
+    record["outputs"] = outputs;
+    // written last, so an interrupted store never matches
+    writeIfChanged(recordFile(), record.dump(2) + "\n");
+}
@@ -0,0 +1,315 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ****************************************************************************/
+
+/* Normalized signature keys.  The same function is spelled differently
+ * by libclang and by the demangler: "const std::string &" vs.
+ * "std::__cxx11::basic_string<char, std::char_traits<char>,
+ * std::allocator<char> > const&", ABI tags, inline namespaces, spacing.
+ * normalizeSignature() reduces both spellings to one form, token by token:
+ *   - inline namespaces (__cxx11, __1) and ABI tags are dropped
+ *   - default template arguments (allocators, traits, comparators) are dropped
+ *   - std::basic_string<char> becomes std::string
+ *   - const (and volatile) are moved to the right of the type they modify
+ *   - the return type and noexcept are dropped, const methods keep "const"
+ *   - tokens are joined with a single space only between two words
+ * The header side should be built from canonical types, so typedefs and
+ * aliases are already resolved by clang. */
+
+#pragma once
+
+#include <ctype.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/* Split a signature into words (qualified names, keywords, numbers)
+ * and single punctuation characters */
+inline std::vector<std::string> tokenizeSignature(const std::string& in) {
+    // drop the ABI tags, i.e. "getMessage[abi:cxx11]"
+    std::string s{in};
+    size_t tag;
+    while ((tag = s.find("[abi:")) != std::string::npos) {
+        size_t close = s.find(']', tag);
+        if (close == std::string::npos) {
+            break;
+        }
+        s.erase(tag, close - tag + 1);
+    }
+    std::vector<std::string> tokens;
+    size_t n = s.size();
+    size_t i = 0;
+    while (i < n) {
+        char c = s[i];
+        if (isspace((unsigned char)c)) {
+            i++;
+            continue;
+        }
+        if (isalnum((unsigned char)c) || c == '_' || c == '~' ||
+            (c == ':' && i + 1 < n && s[i+1] == ':')) {
+            size_t start = i;
+            while (i < n && (isalnum((unsigned char)s[i]) || s[i] == '_' ||
+                   s[i] == '~' ||
+                   (s[i] == ':' && i + 1 < n && s[i+1] == ':'))) {
+                i += (s[i] == ':') ? 2 : 1;
+            }
+            // remove the inline namespaces
+            std::string word{s.substr(start, i - start)};
+            const char * inlines[] = {"__cxx11::", "__1::"};
+            for (auto ns : inlines) {
+                size_t found;
+                while ((found = word.find(std::string("::") + ns)) != std::string::npos) {
+                    word.erase(found + 2, strlen(ns));
+                }
+            }
+            tokens.push_back(word);
+            continue;
+        }
+        tokens.push_back(std::string(1, c));
+        i++;
+    }
+    return tokens;
+}
+
+inline bool isSignatureWord(const std::string& token) {
+    return token.size() > 0 && (isalnum((unsigned char)token[0]) ||
+        token[0] == '_' || token[0] == '~' || token[0] == ':');
+}
+
+/* Find the bracket matching tokens[open], or end if there isn't one */
+inline size_t matchingToken(const std::vector<std::string>& tokens,
+    size_t open, size_t end) {
+    int depth = 0;
+    for (size_t i = open ; i < end ; i++) {
+        if (tokens[i] == "<" || tokens[i] == "(" || tokens[i] == "[") {
+            depth++;
+        } else if (tokens[i] == ">" || tokens[i] == ")" || tokens[i] == "]") {
+            depth--;
+            if (depth == 0) {
+                return i;
+            }
+        }
+    }
+    return end;
+}
+
+inline std::string normalizeTypeList(const std::vector<std::string>& tokens,
+    size_t begin, size_t end);
+
+/* One type: [const] name[<args>] [const] [*|&]... */
+inline std::string normalizeType(const std::vector<std::string>& tokens,
+    size_t begin, size_t end) {
+    std::vector<std::string> pieces;
+    for (size_t i = begin ; i < end ; i++) {
+        const std::string& t = tokens[i];
+        if (t == "<" || t == "(") {
+            size_t close = matchingToken(tokens, i, end);
+            std::string inner{normalizeTypeList(tokens, i + 1, close)};
+            if (t == "<" && pieces.size() > 0 &&
+                pieces.back() == "std::basic_string" && inner == "char") {
+                pieces.back() = "std::string";
+            } else {
+                pieces.push_back(t + inner + (t == "<" ? ">" : ")"));
+            }
+            i = close;
+        } else {
+            pieces.push_back(t);
+        }
+    }
+    // move leading cv-qualifiers after the type they modify
+    std::vector<std::string> qualifiers;
+    while (pieces.size() > 0 && (pieces[0] == "const" || pieces[0] == "volatile")) {
+        qualifiers.push_back(pieces[0]);
+        pieces.erase(pieces.begin());
+    }
+    if (qualifiers.size() > 0) {
+        size_t after = 0;
+        while (after < pieces.size() && pieces[after] != "*" &&
+               pieces[after] != "&" && pieces[after] != "const" &&
+               pieces[after] != "volatile" && pieces[after][0] != '(') {
+            after++;
+        }
+        pieces.insert(pieces.begin() + after, qualifiers.begin(), qualifiers.end());
+    }
+    std::string result;
+    for (size_t i = 0 ; i < pieces.size() ; i++) {
+        if (i > 0 && isSignatureWord(pieces[i-1]) && isSignatureWord(pieces[i])) {
+            result += " ";
+        }
+        result += pieces[i];
+    }
+    return result;
+}
+
+/* A comma separated list of types, without the default template arguments */
+inline std::string normalizeTypeList(const std::vector<std::string>& tokens,
+    size_t begin, size_t end) {
+    const char * defaults[] = {"std::allocator<", "std::char_traits<",
+        "std::less<", "std::hash<", "std::equal_to<", "std::default_delete<"};
+    std::string result;
+    size_t start = begin;
+    for (size_t i = begin ; i <= end ; i++) {
+        if (i < end && (tokens[i] == "<" || tokens[i] == "(")) {
+            i = matchingToken(tokens, i, end);
+            continue;
+        }
+        if (i < end && tokens[i] != ",") {
+            continue;
+        }
+        std::string type{normalizeType(tokens, start, i)};
+        start = i + 1;
+        bool isDefault{false};
+        for (auto d : defaults) {
+            if (type.compare(0, strlen(d), d) == 0) {
+                isDefault = true;
+            }
+        }
+        if (isDefault || type.size() == 0) {
+            continue;
+        }
+        if (result.size() > 0) {
+            result += ",";
+        }
+        result += type;
+    }
+    return result;
+}
+
+/* The normalized key for a function signature, with or without a return
+ * type.  Returns an empty string if the signature can't be handled. */
+inline std::string normalizeSignature(const std::string& signature) {
+    if (signature.find("operator") != std::string::npos ||
+        signature.find("type-parameter") != std::string::npos) {
+        return "";
+    }
+    std::vector<std::string> tokens{tokenizeSignature(signature)};
+    // skip the method qualifiers at the end
+    size_t close = tokens.size();
+    std::vector<std::string> qualifiers;
+    while (close > 0 && tokens[close-1] != ")") {
+        const std::string& t = tokens[close-1];
+        if (t == "const" || t == "volatile" || t == "&") {
+            qualifiers.insert(qualifiers.begin(), t);
+        } else if (t != "noexcept") {
+            return "";
+        }
+        close--;
+    }
+    if (close == 0) {
+        return "";
+    }
+    close--;
+    // find the start of the argument list
+    size_t open = close;
+    int depth = 0;
+    while (true) {
+        if (tokens[open] == ")") { depth++; }
+        if (tokens[open] == "(") { depth--; }
+        if (depth == 0 || open == 0) { break; }
+        open--;
+    }
+    if (depth != 0 || open == 0) {
+        return "";
+    }
+    // the function name is the last word before the arguments, plus
+    // its template arguments (and those of its classes, "A<int>::f");
+    // anything before that is the return type
+    size_t name = open;
+    while (true) {
+        if (name > 0 && tokens[name-1] == ">") {
+            int angles = 0;
+            while (name > 0) {
+                name--;
+                if (tokens[name] == ">") { angles++; }
+                if (tokens[name] == "<") { angles--; }
+                if (angles == 0) { break; }
+            }
+            if (angles != 0) {
+                return "";
+            }
+        }
+        if (name == 0 || !isSignatureWord(tokens[name-1])) {
+            return "";
+        }
+        name--;
+        if (tokens[name].compare(0, 2, "::") != 0 ||
+            name == 0 || tokens[name-1] != ">") {
+            break;
+        }
+    }
+    std::string key{normalizeType(tokens, name, open)};
+    std::string arguments{normalizeTypeList(tokens, open + 1, close)};
+    // "(void)" is the same as "()"
+    if (arguments == "void") {
+        arguments = "";
+    }
+    key += "(" + arguments + ")";
+    for (auto& q : qualifiers) {
+        key += (q == "&") ? q : " " + q;
+    }
+    return key;
+}
+
+/* The qualified function name in a demangled signature, without the
+ * return type, the arguments or any ABI tags.  hasReturnType is set if
+ * there was anything before the name.  Returns false for operators and
+ * anything else that can't be split. */
+inline bool demangledFunctionName(const std::string& demangled,
+    std::string& name, bool& hasReturnType) {
+    if (demangled.find("operator") != std::string::npos) {
+        return false;
+    }
+    std::string s{demangled};
+    size_t tag;
+    while ((tag = s.find("[abi:")) != std::string::npos) {
+        size_t close = s.find(']', tag);
+        if (close == std::string::npos) {
+            return false;
+        }
+        s.erase(tag, close - tag + 1);
+    }
+    // find the argument list, matching the last closing parenthesis
+    size_t close = s.rfind(')');
+    if (close == std::string::npos) {
+        return false;
+    }
+    size_t open = close;
+    int depth = 0;
+    while (true) {
+        if (s[open] == ')') { depth++; }
+        if (s[open] == '(') { depth--; }
+        if (depth == 0 || open == 0) { break; }
+        open--;
+    }
+    if (depth != 0 || open == 0) {
+        return false;
+    }
+    // walk back over the name, including any template arguments
+    size_t start = open;
+    int angles = 0;
+    while (start > 0) {
+        char c = s[start-1];
+        if (c == '>') {
+            angles++;
+        } else if (c == '<') {
+            if (angles == 0) {
+                return false;
+            }
+            angles--;
+        } else if (angles == 0 && !(isalnum((unsigned char)c) ||
+                   c == '_' || c == '~' || c == ':')) {
+            break;
+        }
+        start--;
+    }
+    if (angles != 0 || start == open) {
+        return false;
+    }
+    name = s.substr(start, open - start);
+    hasReturnType = (start > 0);
+    return true;
+}
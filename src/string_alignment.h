@@ -12,6 +12,7 @@
 // Found at https://www.geeksforgeeks.org/sequence-alignment-problem/
 // Fixed by khuck
 #include <string>
+#include <vector>
 #include <iostream>
 #include <algorithm>
 
@@ -152,6 +153,42 @@ int getMinimumPenalty(std::string x, std::string y, int pxy, int pgap, bool repo
     return penalty;
 }
 
+/* The same alignment, but over sequences of tokens (interned to integers)
+ * instead of characters.  Signatures are 10-30 times shorter as tokens, and
+ * a long template argument costs one mismatch instead of dozens.  Only the
+ * penalty is needed, so two rows of the table are enough. */
+template <class T>
+int getMinimumTokenPenalty(const std::vector<T>& x, const std::vector<T>& y,
+    int pxy, int pgap)
+{
+	size_t m = x.size();
+	size_t n = y.size();
+	std::vector<int> previous(n+1);
+	std::vector<int> current(n+1);
+	for (size_t j = 0; j <= n; j++) {
+		previous[j] = j * pgap;
+	}
+	for (size_t i = 1; i <= m; i++)
+	{
+		current[0] = i * pgap;
+		for (size_t j = 1; j <= n; j++)
+		{
+			if (x[i - 1] == y[j - 1])
+			{
+				current[j] = previous[j - 1];
+			}
+			else
+			{
+				current[j] = std::min(std::min(previous[j - 1] + pxy ,
+								   previous[j] + pgap) ,
+								current[j - 1] + pgap );
+			}
+		}
+		previous.swap(current);
+	}
+	return previous[n];
+}
+
 #if 0
 // Driver code
 int main(){
@@ -0,0 +1,205 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ****************************************************************************/
+
+/* Interned strings for the generator.  Namespace segments, class names
+ * and type spellings are stored once, and referred to by a small integer
+ * id, so the generator can copy, compare and hash them cheaply.  Derived
+ * names (qualified names, template instantiations and template parameter
+ * substitutions) are cached by the ids of their parts, so they are only
+ * built once no matter how many methods or permutations use them.
+ *
+ * The strings live in fixed-size chunks that never move, so looking up
+ * the string for an id needs no lock.  Interning takes a lock, so the
+ * table can be shared by the generator threads. */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+
+typedef uint32_t stringId_t;
+typedef std::vector<stringId_t> stringIds_t;
+
+class StringTable {
+public:
+    StringTable() : _size(0) {
+        _chunks.reserve(maxChunks);
+        // id 0 is always the empty string
+        intern(std::string(""));
+    }
+    ~StringTable() {
+        for (auto chunk : _chunks) {
+            delete [] chunk;
+        }
+    }
+    stringId_t intern(const char * s, size_t length) {
+        std::lock_guard<std::mutex> guard(_lock);
+        return internLocked(s, length);
+    }
+    stringId_t intern(const std::string& s) {
+        return intern(s.data(), s.size());
+    }
+    const std::string& str(stringId_t id) const {
+        return _chunks[id >> chunkBits][id & (chunkSize - 1)];
+    }
+    std::vector<std::string> strs(const stringIds_t& ids) const {
+        std::vector<std::string> result;
+        result.reserve(ids.size());
+        for (auto id : ids) {
+            result.push_back(str(id));
+        }
+        return result;
+    }
+    stringIds_t intern(const std::vector<std::string>& strings) {
+        stringIds_t result;
+        result.reserve(strings.size());
+        for (auto& s : strings) {
+            result.push_back(intern(s));
+        }
+        return result;
+    }
+    /* "prefix::name", or just "name" if the prefix is empty */
+    stringId_t qualify(stringId_t prefix, stringId_t name) {
+        if (prefix == 0) {
+            return name;
+        }
+        return derive(0, prefix, name, 0, [&]() {
+            return str(prefix) + "::" + str(name);
+        });
+    }
+    stringId_t qualify(const stringIds_t& ids, stringId_t prefix = 0) {
+        for (auto id : ids) {
+            prefix = qualify(prefix, id);
+        }
+        return prefix;
+    }
+    /* "name<arg1, arg2, ...>" */
+    stringId_t instantiate(stringId_t name, const stringIds_t& args) {
+        stringId_t result = name;
+        for (size_t i = 0 ; i < args.size() ; i++) {
+            // each step is cached, keyed by the partial result
+            bool last = (i == args.size() - 1);
+            stringId_t partial = result;
+            stringId_t arg = args[i];
+            result = derive(1, partial, arg, last ? 1 : 0, [&]() {
+                std::string tmp{str(partial)};
+                tmp += (i == 0) ? "<" : ", ";
+                tmp += str(arg);
+                if (last) { tmp += ">"; }
+                return tmp;
+            });
+        }
+        return result;
+    }
+    /* replace all occurrences of "from" in "type" with "to" */
+    stringId_t substitute(stringId_t type, stringId_t from, stringId_t to) {
+        return derive(2, type, from, to, [&]() {
+            std::string tmp{str(type)};
+            const std::string& f = str(from);
+            const std::string& t = str(to);
+            std::string::size_type n = 0;
+            while (f.size() > 0 &&
+                   ( n = tmp.find( f, n ) ) != std::string::npos ) {
+                tmp.replace( n, f.size(), t);
+                n += t.size();
+            }
+            return tmp;
+        });
+    }
+    size_t size() const { return _size; }
+private:
+    static const size_t chunkBits = 12;
+    static const size_t chunkSize = 1 << chunkBits;
+    static const size_t maxChunks = 1 << 16;
+    /* A view of a stored string, for looking up without allocating */
+    struct view_t {
+        const char * data;
+        size_t length;
+        bool operator==(const view_t& other) const {
+            return length == other.length &&
+                memcmp(data, other.data, length) == 0;
+        }
+    };
+    struct keyHash {
+        size_t operator()(const view_t& key) const {
+            uint64_t hash = 14695981039346656037ULL;
+            for (size_t i = 0 ; i < key.length ; i++) {
+                hash ^= (unsigned char)(key.data[i]);
+                hash *= 1099511628211ULL;
+            }
+            return (size_t)hash;
+        }
+    };
+    /* A string derived from up to three other strings */
+    struct derivedKey_t {
+        uint32_t op;
+        stringId_t a, b, c;
+        bool operator==(const derivedKey_t& o) const {
+            return op == o.op && a == o.a && b == o.b && c == o.c;
+        }
+    };
+    struct derivedHash {
+        size_t operator()(const derivedKey_t& k) const {
+            uint64_t hash = ((uint64_t)k.a << 32) ^ k.b;
+            hash ^= ((uint64_t)k.c << 40) ^ ((uint64_t)k.op << 60);
+            hash *= 0x9E3779B97F4A7C15ULL;
+            return (size_t)(hash ^ (hash >> 29));
+        }
+    };
+    std::vector<std::string*> _chunks;
+    size_t _size;
+    std::unordered_map<view_t, stringId_t, keyHash> _index;
+    std::unordered_map<derivedKey_t, stringId_t, derivedHash> _derived;
+    std::mutex _lock;
+
+    stringId_t internLocked(const char * s, size_t length) {
+        view_t key{s, length};
+        auto found = _index.find(key);
+        if (found != _index.end()) {
+            return found->second;
+        }
+        if ((_size & (chunkSize - 1)) == 0) {
+            if (_chunks.size() == maxChunks) {
+                fprintf(stderr, "String table is full!\n");
+                abort();
+            }
+            // reserved up front, so readers never see the vector move
+            _chunks.push_back(new std::string[chunkSize]);
+        }
+        stringId_t id = (stringId_t)_size;
+        std::string& stored = _chunks[id >> chunkBits][id & (chunkSize - 1)];
+        stored.assign(s, length);
+        _size++;
+        view_t storedKey{stored.data(), stored.size()};
+        _index[storedKey] = id;
+        return id;
+    }
+    template<class F>
+    stringId_t derive(uint32_t op, stringId_t a, stringId_t b, stringId_t c, F build) {
+        derivedKey_t key{op, a, b, c};
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            auto found = _derived.find(key);
+            if (found != _derived.end()) {
+                return found->second;
+            }
+        }
+        // build the string outside the lock, the parts never change
+        std::string tmp{build()};
+        std::lock_guard<std::mutex> guard(_lock);
+        stringId_t id = internLocked(tmp.data(), tmp.size());
+        _derived[key] = id;
+        return id;
+    }
+};
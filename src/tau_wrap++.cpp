@@ -35,10 +35,25 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <mutex>
+#include <chrono>
 #include <clang-c/Index.h>
 #include <cctype>
 #include <locale>
 #include "string_alignment.h"
+#include "wrapper_output.h"
+#include "result_cache.h"
+#include "thread_pool.h"
+#include "string_table.h"
+#include "alias_resolver.h"
+#include "signature_key.h"
+#include "assignment.h"
+#include "phase_timer.h"
+#include "profile_reader.h"
+#include "wrapper_runtime.h"
 #include "json.h"
 using json = nlohmann::json;
 json configuration;
@@ -92,7 +107,7 @@ bool replace_all(std::string& instr, const std::string old, const std::string ne
     return changed;
 }
 
-bool contains(std::string& instr, const std::string needle) {
+bool contains(const std::string& instr, const std::string needle) {
     return ( ( instr.find( needle ) ) != std::string::npos );
 }
 
@@ -123,6 +138,26 @@ const std::string skip_methods{"methods to skip"};
 const std::string tau_timer_group{"TAU timer group"};
 const std::string enable_trace_plugin{"enable trace plugin"};
 const std::string printable_trace_types{"printable trace types"};
+const std::string output_shards{"output shards"};
+const std::string result_cache{"result cache"};
+const std::string alignment_mode{"alignment mode"};
+const std::string match_report{"match report"};
+const std::string log_level{"log level"};
+const std::string profiling_backend{"profiling backend"};
+const std::string interposition{"interposition"};
+const std::string profile_files{"profile"};
+const std::string overhead_budget{"overhead budget"};
+const std::string full_wrapper_cost{"full wrapper cost"};
+const std::string count_wrapper_cost{"count wrapper cost"};
+const std::string instance_profiling{"instance profiling"};
+const std::string instance_limit{"instance limit"};
+const std::string data_volume{"data volume"};
+const std::string deferred_operations{"deferred operations"};
+const std::string timer_arguments{"timer arguments"};
+const std::string timer_argument_limit{"timer argument limit"};
+const std::string call_sites{"call sites"};
+const std::string call_site_limit{"call site limit"};
+const std::string latency_histograms{"latency histograms"};
 
 /* This is the default configuration.
  * For different environments, use a configuration file.
@@ -139,6 +174,106 @@ const std::string printable_trace_types{"printable trace types"};
  *       the `-x c++` flag tells libclang that this is a C++ file.
  *       Enable any flags that would be used to compile an application
  *       that uses the library to be wrapped.
+ *   output shards: (optional) Split the generated wrapper into this many
+ *       source files (wr_0.cpp, wr_1.cpp, ...) plus a common header,
+ *       grouped by outermost class.  A manifest of declaration hashes
+ *       (wr.manifest) is kept, and files whose content did not change
+ *       are not rewritten, so only the changed shards get recompiled.
+ *   result cache: (optional) A directory for caching the results.  If the
+ *       tool, command line, configuration, libraries and all the files
+ *       included by the header are unchanged since the last run, the
+ *       cached wrapper is restored instead of parsing and matching.
+ *   alignment mode: (optional) "token" (the default) aligns signatures that
+ *       couldn't be matched exactly token by token, "character" aligns them
+ *       character by character, which is much slower.
+ *   match report: (optional) Where to write the report of how every method
+ *       was matched (or not) to a library symbol, and which library symbols
+ *       were never bound.  The default is match_report.json, a name ending
+ *       in .csv writes a table instead, and "" writes no report.
+ *   log level: (optional) "off" prints only the results and errors,
+ *       "summary" (the default) also prints the classes found and the
+ *       time spent in each phase, and "full" also prints a dot for every
+ *       cursor and writes every cursor to cursor.log and every library
+ *       symbol to symbol.log.
+ *   profiling backend: (optional) "tau" (the default) generates wrappers
+ *       that are built and run with TAU.  "builtin" generates wrappers
+ *       with their own minimal profiler instead, which needs nothing but
+ *       the library and writes a flat profile (and the trace events, if
+ *       the trace plugin is enabled) at exit.
+ *   interposition: (optional) How the wrapper gets between the application
+ *       and the library.  "dlopen" (the default) is for loading with
+ *       tau_exec -loadlib, each wrapper opens the library and looks up the
+ *       original function the first time it is called.  "preload" is for
+ *       LD_PRELOAD, the original functions are all looked up with
+ *       dlsym(RTLD_NEXT) when the wrapper is loaded.  "link" is for
+ *       linking with the library (which can be a static archive): the
+ *       wrappers are named __wrap_<mangled name> and call the original as
+ *       __real_<mangled name>, and the linker options to rename the calls
+ *       are written to wr.link, to be used as "-Wl,@wr.link".  "got" is
+ *       for attaching to a running application: when the wrapper is loaded
+ *       (with LD_PRELOAD, dlopen or injected by a debugger) it points the
+ *       GOT entries for the wrapped functions at the wrappers, in every
+ *       loaded object.  tau_wrap_attach() and tau_wrap_detach() in the
+ *       wrapper redo and undo that, so the instrumentation can be on for
+ *       just a window, and costs nothing once detached.  Objects opened
+ *       with dlopen after attaching aren't patched until tau_wrap_attach()
+ *       is called again, and the patched objects stay loaded until
+ *       detaching.  Set TAU_WRAP_ATTACH=0 to load the wrapper without
+ *       attaching.
+ *   profile: (optional) A profile from a previous run (or a list of them),
+ *       either TAU profile.* files or the builtin wrapper_profile.*.txt.
+ *       With a profile, each method gets a full wrapper, a wrapper that
+ *       only counts the calls, or no wrapper at all, depending on its
+ *       mean time per call.  Methods that weren't called keep what
+ *       they got the last time (recorded in wr.manifest), or get a full
+ *       wrapper.
+ *   overhead budget: (optional) The most time a wrapper can add to a
+ *       call, in percent of the mean time of the call.  Default 1.0.
+ *   full wrapper cost: (optional) The time a full wrapper adds to a call,
+ *       in nanoseconds (benchmark/overhead measures it).  Default 1000.
+ *   count wrapper cost: (optional) The time a counting wrapper adds to a
+ *       call, in nanoseconds.  Default 100.
+ *   instance profiling: (optional) The classes (i.e. "adios2::Engine")
+ *       whose methods are timed per object instead of per method.  Each
+ *       object gets an id the first time it is seen, and the timers are
+ *       named "[WRAPPER] <signature> [instance <id>]".
+ *   instance limit: (optional) How many objects get their own timers,
+ *       after that they share the "[instance overflow]" timers.  Default 64.
+ *   data volume: (optional) The methods that move data, each with an
+ *       expression for the number of bytes a call moves, in terms of the
+ *       parameters.  The methods are given by name ("adios2::Engine::Put")
+ *       or by signature, for just one overload.  The wrapper_runtime.h
+ *       helpers cover the usual cases, i.e.
+ *           "wrap_volume::bytes(values)" for a vector or string,
+ *           "wrap_volume::bytes(data, count)" for a pointer and a count,
+ *           "wrap_volume::count_bytes(variable)" for an adios2::Variable<T>,
+ *           i.e. the product of variable.Count() times sizeof(T).
+ *       The bytes (total and per call) and the throughput in MB/s are
+ *       recorded along with the timer.
+ *   deferred operations: (optional) The methods that queue up work
+ *       ("enqueue", i.e. "adios2::Engine::Put") and the methods that do it
+ *       ("flush", i.e. "adios2::Engine::PerformPuts"), by name or by
+ *       signature.  The operations are tracked by the object they were
+ *       called on, and each flush records the queue depth, the latency
+ *       from each enqueue to the end of the flush, and the bytes flushed
+ *       (from the data volume of the enqueue methods) as events.
+ *   timer arguments: (optional) Methods (by name or signature) that get a
+ *       timer for each value of one of their parameters, i.e.
+ *       {"adios2::IO::DefineVariable": "name"}.  The timers are named
+ *       "[WRAPPER] <signature> [<value>]".
+ *   timer argument limit: (optional) How many values each of those
+ *       methods gets timers for, after that they share the
+ *       "[other values]" timer.  Default 16.
+ *   call sites: (optional) true to count the calls to every method by
+ *       where they were called from in the application, or a list of
+ *       methods (by name or signature) to do it for.  The call sites are
+ *       written to wrapper_callsites.<pid>.txt at exit.
+ *   call site limit: (optional) How many call sites are kept for each
+ *       method, the calls from the rest are counted together.  Default 32.
+ *   latency histograms: (optional) true to keep a histogram of the time
+ *       the calls to every method take, or a list of methods (by name or
+ *       signature) to keep one for.  Their percentiles are written to
+ *       wrapper_latency.<pid>.json at exit.
  */
 const char * default_configuration = R"(
 {
@@ -199,7 +334,7 @@ const char * default_configuration = R"(
 void show_usage(char const * argv0)
 {
     std::cout <<"-----------------------------------------------------------------------------"<<std::endl;
-    std::cout <<"Usage : "<< argv0 <<" <header> [-w <library>] [-n <namespace>] [-c <config_file>]"<<std::endl;
+    std::cout <<"Usage : "<< argv0 <<" <header> [-w <library>] [-n <namespace>] [-c <config_file>] [-j <threads>] [-a <application>]"<<std::endl;
     std::cout <<" e.g., "<<std::endl;
     std::cout <<"   " << argv0 << " secret.h -w libsecret.so -n secret -c config.json" << std::endl;
     std::cout <<"-----------------------------------------------------------------------------"<<std::endl;
@@ -208,6 +343,12 @@ void show_usage(char const * argv0)
 typedef struct symbolData {
     std::string mangledName;
     size_t nArgs;
+    // the normalized signature, see signature_key.h
+    std::string signatureKey;
+    // the signature as tokens, for token alignment
+    stringIds_t tokens;
+    // does the demangled signature start with the return type?
+    bool hasReturnType;
 } symbolData_t;
 
 void readConfigFile(std::string filename) {
@@ -231,14 +372,31 @@ void readConfigFile(std::string filename) {
     }
 }
 
-std::ofstream wrapper("wr.cpp", std::ofstream::out);
+// The generated declarations, written to wr.cpp (and shards) at the end
+WrapperOutput output;
+// Time and memory used by each phase, and counts of the work done
+PhaseTimer timers;
 // Map from type signature to mangled name and argument list
 std::map<std::string, symbolData_t> symbolMap;
-// Map from "using" alias to actual type
-std::map<std::string, std::string> aliasMap;
+// Map from normalized signature to type signature (empty if ambiguous)
+std::unordered_map<std::string, std::string> symbolKeys;
+// Map from function name to type signatures, for approximate matching
+std::unordered_map<std::string, std::vector<std::string>> symbolNames;
+// Type signatures without a usable function name (operators, mostly)
+std::vector<std::string> unnamedSymbols;
+// Names and types found in the header, see string_table.h
+StringTable names;
+// The "using" aliases found in the header, see alias_resolver.h
+AliasResolver aliases{names};
 std::string mainNamespace{"secret"};
-
-std::string get_tau_timer_group() {
+// All the files included by the header (and the header itself)
+std::vector<std::string> includedFiles;
+// The symbols the applications (-a) import from the namespace
+std::unordered_set<std::string> importedSymbols;
+// Only wrap the imported symbols, if any applications were given
+bool pruneToImports{false};
+
+std::string read_tau_timer_group() {
     if (configuration.count(tau_timer_group) > 0) {
         std::string group{configuration[tau_timer_group]};
         return group;
@@ -248,13 +406,406 @@ std::string get_tau_timer_group() {
     return group;
 }
 
+/* The configuration is read once, so it's safe to use from many threads */
+std::string get_tau_timer_group() {
+    static std::string group{read_tau_timer_group()};
+    return group;
+}
+
+bool read_trace_enabled() {
+    bool do_trace = false;
+    if (configuration.count(enable_trace_plugin) > 0) {
+        do_trace = configuration[enable_trace_plugin];
+    }
+    return do_trace;
+}
+
+bool trace_enabled() {
+    static bool do_trace{read_trace_enabled()};
+    return do_trace;
+}
+
+bool read_token_alignment() {
+    if (configuration.count(alignment_mode) > 0) {
+        std::string mode{configuration[alignment_mode]};
+        if (mode == "character") {
+            return false;
+        }
+        if (mode != "token") {
+            std::cerr << "Unknown alignment mode '" << mode
+                      << "', using 'token'." << std::endl;
+        }
+    }
+    return true;
+}
+
+bool token_alignment() {
+    static bool do_tokens{read_token_alignment()};
+    return do_tokens;
+}
+
+typedef enum logLevel {
+    log_off,
+    log_summary,
+    log_full
+} logLevel_t;
+
+logLevel_t read_log_level() {
+    if (configuration.count(log_level) > 0) {
+        std::string level{configuration[log_level]};
+        if (level == "off") {
+            return log_off;
+        }
+        if (level == "full") {
+            return log_full;
+        }
+        if (level != "summary") {
+            std::cerr << "Unknown log level '" << level
+                      << "', using 'summary'." << std::endl;
+        }
+    }
+    return log_summary;
+}
+
+logLevel_t get_log_level() {
+    static logLevel_t level{read_log_level()};
+    return level;
+}
+
+typedef enum backend {
+    backend_tau,
+    backend_builtin
+} backend_t;
+
+backend_t read_profiling_backend() {
+    if (configuration.count(profiling_backend) > 0) {
+        std::string backend{configuration[profiling_backend]};
+        if (backend == "builtin") {
+            return backend_builtin;
+        }
+        if (backend != "tau") {
+            std::cerr << "Unknown profiling backend '" << backend
+                      << "', using 'tau'." << std::endl;
+        }
+    }
+    return backend_tau;
+}
+
+backend_t get_profiling_backend() {
+    static backend_t backend{read_profiling_backend()};
+    return backend;
+}
+
+typedef enum interposition {
+    interpose_dlopen,
+    interpose_preload,
+    interpose_link,
+    interpose_got
+} interposition_t;
+
+interposition_t read_interposition() {
+    if (configuration.count(interposition) > 0) {
+        std::string mode{configuration[interposition]};
+        if (mode == "preload") {
+            return interpose_preload;
+        }
+        if (mode == "link") {
+            return interpose_link;
+        }
+        if (mode == "got") {
+            return interpose_got;
+        }
+        if (mode != "dlopen") {
+            std::cerr << "Unknown interposition '" << mode
+                      << "', using 'dlopen'." << std::endl;
+        }
+    }
+    return interpose_dlopen;
+}
+
+interposition_t get_interposition() {
+    static interposition_t mode{read_interposition()};
+    return mode;
+}
+
+double read_config_number(const std::string& key, double defaultValue) {
+    if (configuration.count(key) > 0) {
+        double value = configuration[key];
+        return value;
+    }
+    return defaultValue;
+}
+
+std::set<std::string> loadInstanceClasses() {
+    std::set<std::string> classes;
+    if (configuration.count(instance_profiling) > 0) {
+        for (auto c : configuration[instance_profiling]) {
+            std::string tmp{c};
+            classes.insert(tmp);
+        }
+    }
+    return classes;
+}
+
+std::map<std::string, std::string> loadVolumeExpressions() {
+    std::map<std::string, std::string> expressions;
+    if (configuration.count(data_volume) > 0) {
+        for (auto& e : configuration[data_volume].items()) {
+            std::string tmp{e.value()};
+            expressions[e.key()] = tmp;
+        }
+    }
+    return expressions;
+}
+
+/* The bytes moved by a call to the method, as an expression of its
+ * parameters, or nothing.  The signature is more specific than the name. */
+std::string volumeExpression(const std::string& fullMethodName,
+    const std::string& fullSignature) {
+    static std::map<std::string, std::string> expressions{loadVolumeExpressions()};
+    auto found = expressions.find(fullSignature);
+    if (found == expressions.end()) {
+        found = expressions.find(fullMethodName);
+    }
+    return found == expressions.end() ? _empty : found->second;
+}
+
+typedef enum deferred {
+    deferred_none,
+    deferred_enqueue,
+    deferred_flush
+} deferred_t;
+
+std::set<std::string> loadDeferredMethods(const std::string& role) {
+    std::set<std::string> methods;
+    if (configuration.count(deferred_operations) > 0 &&
+        configuration[deferred_operations].count(role) > 0) {
+        for (auto m : configuration[deferred_operations][role]) {
+            std::string tmp{m};
+            methods.insert(tmp);
+        }
+    }
+    return methods;
+}
+
+std::string getClassFromMethod(std::string fullMethodName);
+
+/* The classes with deferred operations, whose destructors drop them */
+std::set<std::string> loadDeferredClasses() {
+    std::set<std::string> classes;
+    for (auto role : {"enqueue", "flush"}) {
+        for (auto& method : loadDeferredMethods(role)) {
+            // a signature: drop the parameters and the return type
+            std::string name{method.substr(0, method.find("("))};
+            size_t space = name.rfind(" ");
+            if (space != std::string::npos) {
+                name = name.substr(space + 1);
+            }
+            classes.insert(getClassFromMethod(name));
+        }
+    }
+    return classes;
+}
+
+bool deferredClass(const std::string& className) {
+    static std::set<std::string> classes{loadDeferredClasses()};
+    return classes.count(className) > 0;
+}
+
+/* Whether the method queues up deferred operations, or completes them */
+deferred_t deferredRole(const std::string& fullMethodName,
+    const std::string& fullSignature) {
+    static std::set<std::string> enqueue{loadDeferredMethods("enqueue")};
+    static std::set<std::string> flush{loadDeferredMethods("flush")};
+    if (enqueue.count(fullSignature) > 0 || enqueue.count(fullMethodName) > 0) {
+        return deferred_enqueue;
+    }
+    if (flush.count(fullSignature) > 0 || flush.count(fullMethodName) > 0) {
+        return deferred_flush;
+    }
+    return deferred_none;
+}
+
+std::map<std::string, std::string> loadTimerArguments() {
+    std::map<std::string, std::string> arguments;
+    if (configuration.count(timer_arguments) > 0) {
+        for (auto& a : configuration[timer_arguments].items()) {
+            std::string tmp{a.value()};
+            arguments[a.key()] = tmp;
+        }
+    }
+    return arguments;
+}
+
+/* The parameter whose value picks the timer, or nothing */
+std::string timerArgument(const std::string& fullMethodName,
+    const std::string& fullSignature, const std::vector<std::string>& parameterNames) {
+    static std::map<std::string, std::string> arguments{loadTimerArguments()};
+    auto found = arguments.find(fullSignature);
+    if (found == arguments.end()) {
+        found = arguments.find(fullMethodName);
+    }
+    if (found == arguments.end()) {
+        return _empty;
+    }
+    if (std::find(parameterNames.begin(), parameterNames.end(), found->second)
+        == parameterNames.end()) {
+        std::cerr << "No parameter '" << found->second << "' in " << fullSignature
+                  << ", not using it for the timer." << std::endl;
+        return _empty;
+    }
+    return found->second;
+}
+
+/* For the options that are either true, for every method, or a list */
+std::set<std::string> loadMethodList(const std::string& key) {
+    std::set<std::string> methods;
+    if (configuration.count(key) > 0 && configuration[key].is_array()) {
+        for (auto m : configuration[key]) {
+            std::string tmp{m};
+            methods.insert(tmp);
+        }
+    }
+    return methods;
+}
+
+bool methodListed(const std::string& key, const std::set<std::string>& methods,
+    const std::string& fullMethodName, const std::string& fullSignature) {
+    if (configuration.count(key) == 0) {
+        return false;
+    }
+    if (configuration[key].is_boolean()) {
+        bool all = configuration[key];
+        return all;
+    }
+    return methods.count(fullSignature) > 0 || methods.count(fullMethodName) > 0;
+}
+
+/* Whether the calls to the method are counted by call site */
+bool callSitesEnabled(const std::string& fullMethodName,
+    const std::string& fullSignature) {
+    static std::set<std::string> methods{loadMethodList(call_sites)};
+    return methodListed(call_sites, methods, fullMethodName, fullSignature);
+}
+
+/* Whether the method keeps a latency histogram */
+bool latencyEnabled(const std::string& fullMethodName,
+    const std::string& fullSignature) {
+    static std::set<std::string> methods{loadMethodList(latency_histograms)};
+    return methodListed(latency_histograms, methods, fullMethodName, fullSignature);
+}
+
+/* The classes that are profiled per instance */
+bool instanceProfiled(const std::string& className) {
+    static std::set<std::string> classes{loadInstanceClasses()};
+    return classes.count(className) > 0;
+}
+
+// The timers from a previous run, for profile guided generation
+profile_t previousProfile;
+
+typedef enum stubKind {
+    stub_full,
+    stub_count,
+    stub_none
+} stubKind_t;
+
+std::vector<std::string> read_profile_files() {
+    std::vector<std::string> filenames;
+    if (configuration.count(profile_files) == 0) {
+        return filenames;
+    }
+    if (configuration[profile_files].is_array()) {
+        for (auto& f : configuration[profile_files]) {
+            filenames.push_back(f);
+        }
+    } else {
+        std::string tmp{configuration[profile_files]};
+        filenames.push_back(tmp);
+    }
+    return filenames;
+}
+
+/* The methods the profile gave a wrapper that only counts ("count") or no
+ * wrapper ("none"), by timer name.  They are kept in the manifest, because
+ * the next profile doesn't time them: the ones without a wrapper aren't in
+ * it at all, and they would get a full wrapper again. */
+std::map<std::string, std::string> earlierDecisions;
+std::map<std::string, std::string> profileDecisions;
+std::mutex profileDecisionsLock;
+
+void read_profile() {
+    earlierDecisions = output.previousProfiled();
+    ProfileReader reader(previousProfile);
+    for (auto& filename : read_profile_files()) {
+        if (!reader.read(filename)) {
+            std::cerr << "Error: can't read the profile " << filename << std::endl;
+            exit(-1);
+        }
+        std::cout << "Read the profile " << filename << std::endl;
+    }
+}
+
+bool profile_guided() {
+    return configuration.count(profile_files) > 0;
+}
+
+/* The profile was measured through full wrappers, so their cost is taken
+ * out of the mean time before comparing the costs with the budget. */
+stubKind_t measuredStubKind(const profileEntry_t& entry) {
+    static double budget{read_config_number(overhead_budget, 1.0) / 100.0};
+    static double fullCost{read_config_number(full_wrapper_cost, 1000.0)};
+    static double countCost{read_config_number(count_wrapper_cost, 100.0)};
+    // counted, not timed, the last time
+    if (entry.inclusive == 0.0) {
+        return stub_count;
+    }
+    double mean = entry.inclusive * 1.0e3 / entry.calls - fullCost;
+    if (fullCost <= budget * mean) {
+        return stub_full;
+    }
+    if (countCost <= budget * mean) {
+        return stub_count;
+    }
+    return stub_none;
+}
+
+/* Methods that weren't called keep what was decided for them before */
+stubKind_t profiledStubKind(const std::string& timerName) {
+    stubKind_t kind{stub_full};
+    auto found = previousProfile.find(timerName);
+    if (found != previousProfile.end() && found->second.calls > 0) {
+        kind = measuredStubKind(found->second);
+    } else {
+        auto earlier = earlierDecisions.find(timerName);
+        if (earlier != earlierDecisions.end()) {
+            kind = earlier->second == "none" ? stub_none : stub_count;
+        }
+    }
+    if (kind != stub_full) {
+        std::lock_guard<std::mutex> guard(profileDecisionsLock);
+        profileDecisions[timerName] = (kind == stub_none ? "none" : "count");
+    }
+    return kind;
+}
+
+std::string match_report_file() {
+    if (configuration.count(match_report) > 0) {
+        std::string filename{configuration[match_report]};
+        return filename;
+    }
+    return "match_report.json";
+}
+
 
 /* Write the preamble to the source file */
 void writePreamble(std::string header, std::vector<std::string> libraries) {
-    constexpr const char * headers = R"(
+    std::stringstream wrapper;
+    constexpr const char * tauHeaders = R"(
 #include <Profile/Profiler.h>
 #include <Profile/TauPluginTypes.h>
-#include <Profile/TauPluginInternals.h>
+#include <Profile/TauPluginInternals.h>)";
+    constexpr const char * headers = R"(
 #include <stdlib.h>
 #include <dlfcn.h>
 #include <string>
@@ -272,7 +823,7 @@ void writePreamble(std::string header, std::vector<std::string> libraries) {
 #endif
 )";
     constexpr const char * loadHandle = R"(
-void * load_handle(const char * tau_orig_libname) {
+inline void * load_handle(const char * tau_orig_libname) {
     MARKER;
     void *handle = (void *) dlopen(tau_orig_libname, RTLD_NOW);
     if (handle == NULL) {
@@ -285,7 +836,7 @@ void * load_handle(const char * tau_orig_libname) {
 }
 )";
     constexpr const char * loadHandles = R"(
-std::vector<void*> load_handles() {
+inline std::vector<void*> load_handles() {
     std::vector<void*> handles;
     if (handles.empty()) {
         const char * names[] = {)";
@@ -311,6 +862,24 @@ template<class T> T* load_symbol(char const* name) {
               << " from libraries!" << std::endl;
     return nullptr;
 }
+)";
+    constexpr const char * loadNextSymbol = R"(
+template<class T> T* load_symbol(char const* name) {
+    MARKER;
+    void * tmp = dlsym(RTLD_NEXT, name);
+    if (tmp == NULL) {
+        std::cerr << "Error obtaining symbol " << name
+                  << " from libraries!" << std::endl;
+    }
+    return reinterpret_cast<T*>(tmp);
+}
+)";
+    constexpr const char * linkPreamble = R"(
+/* The wrappers are extern "C", but return C++ types just like the
+ * functions they wrap */
+#ifdef __clang__
+#pragma clang diagnostic ignored "-Wreturn-type-c-linkage"
+#endif
 )";
     constexpr const char * helperFunctions = R"(
 /* Helper to trace vector parameters */
@@ -431,12 +1000,13 @@ std::string escape_me(T var) {
 
 /* To support the adios2::Dim type */
 template<>
-std::string escape_me <std::vector<long unsigned int>>(std::vector<long unsigned int> var) {
+inline std::string escape_me <std::vector<long unsigned int>>(std::vector<long unsigned int> var) {
     std::string tmp{ToString(var)};
     return tmp;
 }
-
-std::string convert_comm(MPI_Comm comm) {
+)";
+    constexpr const char * convertComm = R"(
+inline std::string convert_comm(MPI_Comm comm) {
     char tmpstr[33];
     if (comm == MPI_COMM_WORLD) {
         sprintf(tmpstr, "MPI_COMM_WORLD");
@@ -454,7 +1024,7 @@ std::string convert_comm(MPI_Comm comm) {
 )";
 
     constexpr const char * tauPluginFunction = R"(
-void Tau_plugin_trace_current_timer(const char * name) {
+inline void Tau_plugin_trace_current_timer(const char * name) {
     /*Invoke plugins only if both plugin path and plugins are specified*/
     if(TauEnv_get_plugins_enabled()) {
         Tau_plugin_event_current_timer_exit_data_t plugin_data;
@@ -468,6 +1038,71 @@ void Tau_plugin_trace_current_timer(const char * name) {
   static void *tauFI = 0; \
   if (tauFI == 0) tauCreateFI(&tauFI, name, "", (TauGroup_t)TAU_USER, "SECRET"); \
   Tau_Profile_Wrapper tauFProf(tauFI);
+)";
+    constexpr const char * tauInstanceMacro = R"(
+#define WRAPPER_INSTANCE(name, id) \
+  static void *tauFIs[TAU_WRAP_INSTANCE_LIMIT + 1] = {0}; \
+  void *&tauFI = tauFIs[id]; \
+  if (tauFI == 0) tauCreateFI(&tauFI, wrap_instances::timer_name(name, id).c_str(), "", (TauGroup_t)TAU_USER, "SECRET"); \
+  Tau_Profile_Wrapper tauFProf(tauFI);
+)";
+    constexpr const char * tauVolumeMacro = R"(
+#include <chrono>
+
+namespace wrap_volume {
+
+/* Triggers the bytes event now, and the throughput event when the call returns */
+class transfer {
+public:
+    transfer(void * bytesEvent, void * rateEvent, size_t bytes) :
+        _rateEvent(rateEvent), _bytes((double)bytes),
+        _start(std::chrono::steady_clock::now()) {
+        Tau_userevent(bytesEvent, _bytes);
+    }
+    ~transfer() {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - _start;
+        if (elapsed.count() > 0.0) {
+            Tau_userevent(_rateEvent, _bytes / elapsed.count() / 1.0e6);
+        }
+    }
+private:
+    void * _rateEvent;
+    double _bytes;
+    std::chrono::steady_clock::time_point _start;
+};
+
+} // namespace wrap_volume
+
+#define WRAPPER_BYTES(name, bytes) \
+  static void *tauBytes{Tau_get_userevent((std::string(name) + " : Bytes").c_str())}; \
+  static void *tauRate{Tau_get_userevent((std::string(name) + " : MB/s").c_str())}; \
+  wrap_volume::transfer tauTransfer(tauBytes, tauRate, bytes);
+)";
+    constexpr const char * tauValueMacro = R"(
+#define WRAPPER_VALUE(name, value) \
+  static wrap_values::timer_map<void*> tauValues; \
+  void *tauFI = tauValues.find(wrap_values::key(value), [&](const std::string& label) { \
+    void *tmpFI = 0; \
+    tauCreateFI(&tmpFI, wrap_values::timer_name(name, label).c_str(), "", (TauGroup_t)TAU_USER, "SECRET"); \
+    return tmpFI; \
+  }); \
+  Tau_Profile_Wrapper tauFProf(tauFI);
+)";
+    constexpr const char * tauEvents = R"(
+typedef void * wrap_event_t;
+
+inline wrap_event_t wrap_event(const std::string& name) {
+    return Tau_get_userevent(name.c_str());
+}
+
+inline void wrap_trigger(wrap_event_t event, double value) {
+    Tau_userevent(event, value);
+}
+)";
+    constexpr const char * tauCountMacro = R"(
+#define WRAPPER_COUNT(name) \
+  static void *tauUE{Tau_get_userevent(name)}; \
+  Tau_userevent(tauUE, 1.0);
 )";
 #ifdef _WIN32
     char sep = '\\';
@@ -476,6 +1111,10 @@ void Tau_plugin_trace_current_timer(const char * name) {
 #endif
 
     // write the basic headers
+    bool tau{get_profiling_backend() == backend_tau};
+    if (tau) {
+        wrapper << tauHeaders;
+    }
     wrapper << headers;
     // write the library header
     wrapper << "#include \"";
@@ -487,34 +1126,92 @@ void Tau_plugin_trace_current_timer(const char * name) {
     }
     wrapper  << "\"\n";
     // write our utility functions
-    wrapper << loadHandle;
-    wrapper << loadHandles;
-    std::string delimiter = "\"";
-    for(auto library : libraries) {
-        wrapper << delimiter;
-        i = library.rfind(sep, library.length());
-        if (i != std::string::npos) {
-            wrapper << (library.substr(i+1, library.length()));
-        } else {
-            wrapper << library;
+    if (get_interposition() == interpose_preload) {
+        wrapper << loadNextSymbol;
+    } else if (get_interposition() == interpose_link) {
+        wrapper << linkPreamble;
+    } else if (get_interposition() == interpose_got) {
+        wrapper << linkPreamble;
+        wrapper << gotPatcher;
+        output.addEpilogue(gotEntryPoints);
+    } else {
+        wrapper << loadHandle;
+        wrapper << loadHandles;
+        std::string delimiter = "\"";
+        for(auto library : libraries) {
+            wrapper << delimiter;
+            i = library.rfind(sep, library.length());
+            if (i != std::string::npos) {
+                wrapper << (library.substr(i+1, library.length()));
+            } else {
+                wrapper << library;
+            }
+            wrapper << "\"";
+            delimiter = ", \"";
         }
-        wrapper << "\"";
-        delimiter = ", \"";
+        wrapper << loadHandles2;
+        wrapper << loadSymbol;
     }
-    wrapper << loadHandles2;
-    wrapper << loadSymbol;
-    wrapper << helperFunctions << "\n";
-    bool do_trace = false;
-    if (configuration.count(enable_trace_plugin) > 0) {
-        do_trace = configuration[enable_trace_plugin];
+    wrapper << helperFunctions;
+    if (tau) {
+        wrapper << convertComm << "\n";
+    } else {
+        // without TAU, MPI_Comm is only defined if the library uses MPI
+        wrapper << "#ifdef MPI_VERSION" << convertComm << "#endif\n";
+        wrapper << builtinProfiler;
     }
+    bool do_trace = trace_enabled();
     if (do_trace) {
-        wrapper << tauPluginFunction;
+        wrapper << (tau ? tauPluginFunction : builtinTraceFunction);
     }
     // write our tau macro
-    std::string tmp{tauMacro};
+    std::string tmp{tau ? tauMacro : builtinMacro};
     replace_all(tmp, "SECRET", get_tau_timer_group());
     wrapper << tmp << "\n";
+    // and the one for the per-instance timers
+    if (configuration.count(instance_profiling) > 0) {
+        wrapper << "#define TAU_WRAP_INSTANCE_LIMIT "
+                << (size_t)read_config_number(instance_limit, 64) << "\n";
+        wrapper << instanceTable;
+        tmp = tau ? tauInstanceMacro : builtinInstanceMacro;
+        replace_all(tmp, "SECRET", get_tau_timer_group());
+        wrapper << tmp << "\n";
+    }
+    // and the one for the timers picked by an argument
+    if (configuration.count(timer_arguments) > 0) {
+        wrapper << "#define TAU_WRAP_VALUE_LIMIT "
+                << (size_t)read_config_number(timer_argument_limit, 16) << "\n";
+        wrapper << valueTimers;
+        tmp = tau ? tauValueMacro : builtinValueMacro;
+        replace_all(tmp, "SECRET", get_tau_timer_group());
+        wrapper << tmp << "\n";
+    }
+    // the call site tables
+    if (configuration.count(call_sites) > 0) {
+        wrapper << "#define TAU_WRAP_CALL_SITE_LIMIT "
+                << (size_t)read_config_number(call_site_limit, 32) << "\n";
+        wrapper << callSiteTables << "\n";
+    }
+    // the latency histograms
+    if (configuration.count(latency_histograms) > 0) {
+        wrapper << latencyHistograms << "\n";
+        output.addEpilogue(latencySnapshot);
+    }
+    // and the one for the data volume
+    if (configuration.count(data_volume) > 0) {
+        wrapper << volumeHelpers;
+        wrapper << (tau ? tauVolumeMacro : builtinVolumeMacro) << "\n";
+    }
+    // the deferred operations, and the events they're reported with
+    if (configuration.count(deferred_operations) > 0) {
+        wrapper << (tau ? tauEvents : builtinEvents);
+        wrapper << deferredTracker << "\n";
+    }
+    // and the one for the wrappers that only count the calls
+    if (profile_guided()) {
+        wrapper << (tau ? tauCountMacro : builtinCountMacro) << "\n";
+    }
+    output.setPreamble(wrapper.str());
     return;
 }
 
@@ -550,45 +1247,18 @@ bool typeIsAddress(std::string intype) {
     return (ends_with(intype, _address));
 }
 
-void validateParameterNames(std::vector<std::string>& names) {
-    size_t length = names.size();
+void validateParameterNames(stringIds_t& parameterNames) {
+    size_t length = parameterNames.size();
     for (size_t index = 0 ; index < length ; index++) {
-        if (names[index].size() == 0) {
+        // id 0 is the empty string
+        if (parameterNames[index] == 0) {
             std::stringstream ss;
             ss << "arg" << index;
-            std::string tmp{ss.str()};
-            names.at(index) = tmp;
+            parameterNames.at(index) = names.intern(ss.str());
         }
     }
 }
 
-std::string expandType(std::vector<std::string> namespaceName, std::string intype,
-bool isTemplate, std::string templateType, std::string instanceType) {
-    //std::cout << "*** " << intype << std::endl;
-    replace_all(intype, "typename ", "");
-    std::string np{intype};
-    // first, replace the fully qualified namespace, if used
-    if (namespaceName.size() > 0) {
-        std::stringstream ss;
-        for (auto ns : namespaceName ) {
-            ss << ns << "::";
-        }
-        for(auto at : aliasMap) {
-            // add the namespace to the alias
-            std::string tmp{ss.str()+at.first};
-            //std::cout << "Replacing " << tmp << " with " << at.second << " in " << np << std::endl;
-            replace_all(np, tmp, at.second);
-        }
-    }
-    // second, replace the alias alone (if not already done)
-    for(auto at : aliasMap) {
-        //std::cout << "Replacing " << at.first << " with " << at.second << " in " << np << std::endl;
-        replace_all(np, at.first, at.second);
-    }
-    //std::cout << "### " << np << std::endl;
-    return np;
-}
-
 /* Change "const <type> &" to "<type> const &"
  * or     "const <type> *" to "<type> const *"
  * or     "const <type>"   to "<type> const"
@@ -624,43 +1294,104 @@ std::string standardizeConstType(std::string const & intype) {
     return intype;
 }
 
-void standardizeConstTypes(std::vector<std::string>& types) {
-    size_t length = types.size();
-    for (size_t index = 0 ; index < length ; index++) {
-        types.at(index) = standardizeConstType(types[index]);
-    }
-}
-
-std::string makeMangled(
-    std::vector<std::string> namespaceName,
-    std::vector<std::string> className,
-    std::string methodName,
-    std::string methodReturnType,
-    std::string methodType,
-    bool methodStatic,
-    std::vector<std::string> parameterNames,
-    std::vector<std::string> parameterTypes,
-    bool isTemplate,
-    std::string templateType,
-    std::string instanceType){
-    standardizeConstTypes(parameterTypes);
-    // expand the types to aid the search
-    methodReturnType = expandType(namespaceName, methodReturnType, isTemplate, templateType, instanceType);
-    for(size_t i = 0 ; i < parameterTypes.size() ; i++) {
-        parameterTypes[i] = expandType(namespaceName, parameterTypes[i], isTemplate, templateType, instanceType);
+/* A method found while traversing the AST.  The traversal only collects
+ * these, the template instantiation, type expansion, matching and code
+ * generation happen afterwards, in parallel (see processMethods). */
+typedef struct methodDescriptor {
+    stringIds_t namespaceName;
+    stringIds_t className;
+    std::vector<stringIds_t> classTemplates;
+    stringId_t methodName;
+    stringId_t methodReturnType;
+    stringId_t methodType;
+    bool methodStatic;
+    stringIds_t parameterNames;
+    stringIds_t parameterTypes;
+    // as resolved by clang, may depend on the template parameters
+    stringIds_t parameterCanonicalTypes;
+    stringIds_t templateTypes;
+    std::string location;
+    bool isConstructor;
+    bool isDestructor;
+    bool isTemplate;
+    bool modifyName;
+} methodDescriptor_t;
+
+/* One method to be wrapped: either a regular method, or one permutation
+ * of the template instantiation types for a template. */
+typedef struct methodInstance {
+    stringIds_t className;
+    stringId_t methodName;
+    stringId_t methodReturnType;
+    stringIds_t parameterNames;
+    stringIds_t parameterTypes;
+    size_t numSpecializations;
+    // the keys used for searching the symbol map
+    stringId_t fullMethod;
+    std::string signature;
+    std::string signatureWithReturn;
+    std::string signatureKey;
+    // as tokens, for token alignment
+    stringIds_t signatureTokens;
+    stringIds_t signatureWithReturnTokens;
+    // the result of the search
+    std::string methodMangled;
+    std::string matchedKey; // only for approximate matches
+    int score;
+    // for the match report
+    std::string matchStatus; // exact, canonical, approximate or unmatched
+    std::string boundSymbol; // the demangled signature that was matched
+    int runnerUp{-1};        // the second best penalty, if any
+    double matchSeconds{0.0};
+} methodInstance_t;
+
+// All the methods found in the header, in traversal order
+std::vector<methodDescriptor_t> methodDescriptors;
+
+/* Split a signature into identifiers, "::" and single punctuation
+ * characters, interned so the alignment only compares integers */
+stringIds_t alignmentTokens(const std::string& signature) {
+    stringIds_t tokens;
+    size_t n = signature.size();
+    size_t i = 0;
+    while (i < n) {
+        char c = signature[i];
+        size_t start = i;
+        if (isspace((unsigned char)c)) {
+            i++;
+            continue;
+        } else if (isalnum((unsigned char)c) || c == '_' || c == '~') {
+            while (i < n && (isalnum((unsigned char)signature[i]) ||
+                   signature[i] == '_' || signature[i] == '~')) {
+                i++;
+            }
+        } else if (signature.compare(i, 2, "::") == 0) {
+            i += 2;
+        } else {
+            i++;
+        }
+        tokens.push_back(names.intern(signature.data() + start, i - start));
+    }
+    return tokens;
+}
+
+void makeSignatures(const methodDescriptor_t& method, methodInstance_t& instance) {
+    // expand the aliases to aid the search, as seen from the method's class
+    stringId_t namespaceName{names.qualify(method.namespaceName)};
+    stringId_t scope{names.qualify(method.className, namespaceName)};
+    const std::string& methodReturnType =
+        names.str(aliases.resolve(scope, instance.methodReturnType));
+    std::vector<const std::string*> parameterTypes;
+    for (auto t : instance.parameterTypes) {
+        stringId_t standard{names.intern(standardizeConstType(names.str(t)))};
+        parameterTypes.push_back(&names.str(aliases.resolve(scope, standard)));
     }
     // declare the function type, class and name
     std::stringstream ss;
     //ss << methodReturnType << _space;
-    std::stringstream justMethod;
-    for (auto ns : namespaceName ) {
-        justMethod << ns << "::";
-    }
-    for (auto cn : className ) {
-        justMethod << cn << "::";
-    }
-    justMethod << methodName;
-    std::string fullMethod{justMethod.str()};
+    instance.fullMethod = names.qualify(
+        names.qualify(instance.className, namespaceName), instance.methodName);
+    const std::string& fullMethod = names.str(instance.fullMethod);
     ss << fullMethod;
     // write the arguments
     std::stringstream args;
@@ -671,70 +1402,302 @@ std::string makeMangled(
         //for (auto ns : namespaceName ) {
         //    args << ns << "::";
         //}
-        args << parameterTypes[i];
+        args << *(parameterTypes[i]);
         multiple = true;
     }
     args << ")";
     ss << args.rdbuf();
+    const std::string& methodType = names.str(method.methodType);
     if (methodIsConst(methodType)) {
         ss << _space << _const;
     }
     if (methodIsNoexcept(methodType)) {
         ss << _space << _noexcept;
     }
-    std::string signature{ss.str()};
-    std::string signatureWithReturn{methodReturnType+_space+signature};
-    if (symbolMap.count(signature) == 1) {
-        std::string mangled{symbolMap[signature].mangledName};
-        symbolMap.erase(signature);
-        return mangled;
-    }
-    if (symbolMap.count(signatureWithReturn) == 1) {
-        std::string mangled{symbolMap[signatureWithReturn].mangledName};
-        symbolMap.erase(signatureWithReturn);
-        return mangled;
-    }
-    // no worries, we'll try string alignment.
+    instance.signature = ss.str();
+    instance.signatureWithReturn = methodReturnType+_space+instance.signature;
+    if (token_alignment()) {
+        instance.signatureTokens = alignmentTokens(instance.signature);
+        instance.signatureWithReturnTokens = alignmentTokens(instance.signatureWithReturn);
+    }
+    // the canonical types are already expanded, and spelled consistently,
+    // but types that depend on the template parameters can't be used.
+    std::stringstream canonical;
+    canonical << fullMethod << "(";
+    for (size_t i = 0 ; i < parameterTypes.size() ; i++) {
+        if (i > 0) { canonical << ", "; }
+        const std::string& ct = names.str(method.parameterCanonicalTypes[i]);
+        if (ct.size() > 0 && !contains(ct, "type-parameter")) {
+            canonical << ct;
+        } else {
+            canonical << *(parameterTypes[i]);
+        }
+    }
+    canonical << ")";
+    if (methodIsConst(methodType)) {
+        canonical << _space << _const;
+    }
+    instance.signatureKey = normalizeSignature(canonical.str());
+}
+
+/* Index the symbols by their normalized signature, and by function name.
+ * If two symbols have the same key, neither can be matched by key. */
+void indexSymbols() {
+    symbolKeys.clear();
+    symbolNames.clear();
+    unnamedSymbols.clear();
+    for (auto& symbol : symbolMap) {
+        std::string name;
+        bool hasReturnType{false};
+        if (demangledFunctionName(symbol.first, name, hasReturnType)) {
+            symbolNames[name].push_back(symbol.first);
+        } else {
+            unnamedSymbols.push_back(symbol.first);
+        }
+        symbol.second.hasReturnType = hasReturnType;
+        const std::string& key = symbol.second.signatureKey;
+        if (key.size() == 0) {
+            continue;
+        }
+        if (symbolKeys.count(key) > 0) {
+            symbolKeys[key] = "";
+        } else {
+            symbolKeys[key] = symbol.first;
+        }
+    }
+}
+
+/* Exact matches claim their symbol, so nobody else can match it.
+ * This has to be done in declaration order, on one thread, so that
+ * the results don't depend on the number of threads. */
+bool findExactMatch(methodInstance_t& instance) {
+    if (symbolMap.count(instance.signature) == 1) {
+        instance.methodMangled = symbolMap[instance.signature].mangledName;
+        instance.boundSymbol = instance.signature;
+        symbolMap.erase(instance.signature);
+        return true;
+    }
+    if (symbolMap.count(instance.signatureWithReturn) == 1) {
+        instance.methodMangled = symbolMap[instance.signatureWithReturn].mangledName;
+        instance.boundSymbol = instance.signatureWithReturn;
+        symbolMap.erase(instance.signatureWithReturn);
+        return true;
+    }
+    return false;
+}
+
+/* Same rules as findExactMatch, but with the normalized signature */
+bool findCanonicalMatch(methodInstance_t& instance) {
+    if (instance.signatureKey.size() == 0) {
+        return false;
+    }
+    auto found = symbolKeys.find(instance.signatureKey);
+    if (found == symbolKeys.end() || found->second.size() == 0 ||
+        symbolMap.count(found->second) == 0) {
+        return false;
+    }
+    instance.methodMangled = symbolMap[found->second].mangledName;
+    instance.boundSymbol = found->second;
+    symbolMap.erase(found->second);
+    return true;
+}
+
+/* The alignment penalty between a method and a symbol, or noAssignment
+ * if they can't match.  If the demangled name has no return type, the
+ * method signature is also tried without one. */
+int alignmentCost(const methodInstance_t& instance, const std::string& demangled,
+    const symbolData_t& symbol, uint64_t& alignments, uint64_t& cells) {
     int pxy = 4;
     int pgap = 1;
-    std::string minkey{""};
-    int minval = INT_MAX;
-    //std::cout << "Searching for: " << signature << std::endl;
-    /* First, check if the demangled name includes the return type */
-    for (auto mangle_pair : symbolMap) {
-        if (mangle_pair.first.find(fullMethod, 0) != std::string::npos &&
-            mangle_pair.second.nArgs == parameterTypes.size()) {
-            int penalty = getMinimumPenalty(signatureWithReturn, mangle_pair.first, pxy, pgap);
-            if (penalty < minval) {
-                minval = penalty;
-                minkey = mangle_pair.first;
+    if (symbol.nArgs != instance.parameterTypes.size()) {
+        return noAssignment;
+    }
+    int penalty;
+    if (token_alignment()) {
+        penalty = getMinimumTokenPenalty(instance.signatureWithReturnTokens,
+            symbol.tokens, pxy, pgap);
+        cells += instance.signatureWithReturnTokens.size() * symbol.tokens.size();
+    } else {
+        penalty = getMinimumPenalty(instance.signatureWithReturn, demangled, pxy, pgap);
+        cells += instance.signatureWithReturn.size() * demangled.size();
+    }
+    alignments++;
+    if (!symbol.hasReturnType) {
+        int tmp;
+        if (token_alignment()) {
+            tmp = getMinimumTokenPenalty(instance.signatureTokens,
+                symbol.tokens, pxy, pgap);
+            cells += instance.signatureTokens.size() * symbol.tokens.size();
+        } else {
+            tmp = getMinimumPenalty(instance.signature, demangled, pxy, pgap);
+            cells += instance.signature.size() * demangled.size();
+        }
+        alignments++;
+        penalty = std::min(penalty, tmp);
+    }
+    return penalty;
+}
+
+/* The unclaimed symbols with the same function name as the method */
+std::vector<std::string> candidateSymbols(const std::string& fullMethod) {
+    std::vector<std::string> candidates;
+    auto found = symbolNames.find(fullMethod);
+    if (found != symbolNames.end()) {
+        for (auto& demangled : found->second) {
+            if (symbolMap.count(demangled) > 0) {
+                candidates.push_back(demangled);
             }
         }
+        return candidates;
+    }
+    // operators, the name has to be followed by the arguments or ABI tag
+    for (auto& demangled : unnamedSymbols) {
+        size_t location = demangled.find(fullMethod);
+        size_t next = location + fullMethod.size();
+        if (location != std::string::npos && next < demangled.size() &&
+            (demangled[next] == '(' || demangled[next] == '[') &&
+            symbolMap.count(demangled) > 0) {
+            candidates.push_back(demangled);
+        }
+    }
+    return candidates;
+}
+
+/* No worries, we'll try string alignment.  All the methods with the same
+ * name (the overloads) are matched together, and every symbol is bound to
+ * at most one of them, with the lowest total penalty.  The groups don't
+ * share any symbols, and the symbol map is only read here, so this can be
+ * done for many groups in parallel. */
+void findApproximateMatches(std::vector<methodInstance_t*>& group) {
+    std::vector<std::string> candidates{
+        candidateSymbols(names.str(group[0]->fullMethod))};
+    if (candidates.size() == 0) {
+        return;
     }
-    /* Second, check through the demangled names that don't have return types.
-     * how do we know if they don't have return types? Well, if we search for the
-     * full method in the demangled name, and it doesn't start at 0, skip it. */
-    for (auto mangle_pair : symbolMap) {
-        size_t location = mangle_pair.first.find(fullMethod, 0);
-        if (location != std::string::npos && location == 0 &&
-            mangle_pair.second.nArgs == parameterTypes.size()) {
-            int penalty = getMinimumPenalty(signature, mangle_pair.first, pxy, pgap);
-            if (penalty < minval) {
-                minval = penalty;
-                minkey = mangle_pair.first;
+    std::vector<const symbolData_t*> symbols;
+    for (auto& demangled : candidates) {
+        symbols.push_back(&symbolMap.at(demangled));
+    }
+    std::vector<std::vector<int>> cost(group.size(),
+        std::vector<int>(candidates.size()));
+    uint64_t alignments{0}, cells{0};
+    for (size_t i = 0 ; i < group.size() ; i++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t c = 0 ; c < candidates.size() ; c++) {
+            cost[i][c] = alignmentCost(*(group[i]), candidates[c], *(symbols[c]),
+                alignments, cells);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        group[i]->matchSeconds += elapsed.count();
+    }
+    timers.alignments += alignments;
+    timers.cells += cells;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<int> assignment{solveAssignment(cost)};
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    for (size_t i = 0 ; i < group.size() ; i++) {
+        // share the time to solve the assignment
+        group[i]->matchSeconds += elapsed.count() / group.size();
+        if (assignment[i] < 0) {
+            continue;
+        }
+        const std::string& minkey = candidates[assignment[i]];
+        group[i]->methodMangled = symbolMap.at(minkey).mangledName;
+        group[i]->matchedKey = minkey;
+        group[i]->boundSymbol = minkey;
+        group[i]->score = cost[i][assignment[i]];
+        for (size_t c = 0 ; c < candidates.size() ; c++) {
+            if ((int)c != assignment[i] && cost[i][c] != noAssignment &&
+                (group[i]->runnerUp < 0 || cost[i][c] < group[i]->runnerUp)) {
+                group[i]->runnerUp = cost[i][c];
             }
         }
     }
-    //symbolMap.erase(minkey);
-    if (minkey.size() > 0) {
-        std::string mangled{symbolMap[minkey].mangledName};
-        wrapper << "/* Target: " << signatureWithReturn << "*/\n";
-        wrapper << "/* Found:  " << minkey << "*/\n";
-        wrapper << "/* Score:  " << minval << "*/\n";
-        return mangled;
+}
+
+/* Quote a field for a CSV file, if needed */
+std::string csvField(const std::string& field) {
+    if (field.find_first_of(",\"\n") == std::string::npos) {
+        return field;
     }
-    //std::cout << "NF: " << signatureWithReturn << std::endl;
-    return minkey;
+    std::string tmp{field};
+    replace_all(tmp, "\"", "\"\"");
+    return "\"" + tmp + "\"";
+}
+
+/* Report how every method was matched, and the symbols that weren't */
+void writeMatchReport(const std::vector<std::vector<methodInstance_t>>& instances) {
+    std::string filename{match_report_file()};
+    if (filename.size() == 0) {
+        return;
+    }
+    std::set<std::string> bound;
+    std::map<std::string, size_t> counts;
+    json declarations = json::array();
+    std::stringstream csv;
+    csv << "status,score,runner-up,seconds,method,symbol,demangled,location\n";
+    for (size_t m = 0 ; m < instances.size() ; m++) {
+        std::string location{methodDescriptors[m].location};
+        trim(location);
+        for (auto& instance : instances[m]) {
+            counts[instance.matchStatus]++;
+            if (instance.matchStatus == "approximate") {
+                bound.insert(instance.boundSymbol);
+            }
+            json entry;
+            entry["method"] = instance.signatureWithReturn;
+            entry["location"] = location;
+            entry["status"] = instance.matchStatus;
+            entry["symbol"] = instance.methodMangled;
+            entry["demangled"] = instance.boundSymbol;
+            entry["seconds"] = instance.matchSeconds;
+            std::string score{""};
+            std::string runnerUp{""};
+            if (instance.matchStatus == "approximate") {
+                entry["score"] = instance.score;
+                score = std::to_string(instance.score);
+            }
+            if (instance.runnerUp >= 0) {
+                entry["runner-up"] = instance.runnerUp;
+                runnerUp = std::to_string(instance.runnerUp);
+            }
+            declarations.push_back(entry);
+            csv << instance.matchStatus << "," << score << "," << runnerUp << ","
+                << instance.matchSeconds << "," << csvField(instance.signatureWithReturn)
+                << "," << instance.methodMangled << "," << csvField(instance.boundSymbol)
+                << "," << csvField(location) << "\n";
+        }
+    }
+    // the exact matches were removed from the symbol map
+    json unbound = json::array();
+    for (auto& symbol : symbolMap) {
+        if (bound.count(symbol.first) > 0) {
+            continue;
+        }
+        json entry;
+        entry["demangled"] = symbol.first;
+        entry["symbol"] = symbol.second.mangledName;
+        unbound.push_back(entry);
+        csv << "unbound,,,,," << symbol.second.mangledName << ","
+            << csvField(symbol.first) << ",\n";
+    }
+    json report;
+    report["summary"]["declarations"] = declarations.size();
+    for (auto& c : counts) {
+        report["summary"][c.first] = c.second;
+    }
+    report["summary"]["unbound symbols"] = unbound.size();
+    report["declarations"] = declarations;
+    report["unbound symbols"] = unbound;
+    std::ofstream out(filename);
+    if (ends_with(filename, ".csv")) {
+        out << csv.str();
+    } else {
+        out << report.dump(2) << std::endl;
+    }
+    out.close();
+    std::cout << "Wrote the match report to " << filename << " ("
+              << unbound.size() << " library symbols not bound)" << std::endl;
 }
 
 bool hasReturnType(std::string methodReturnType, bool isConstructor, bool isDestructor) {
@@ -855,23 +1818,27 @@ std::string trimSpecialization(std::string fullType) {
 }
 
 void writeThisValue(
-    std::ofstream& wrapper,
-    std::string& fullMethodName,
-    bool hasThis
+    std::ostream& wrapper,
+    const std::string& fullMethodName,
+    bool hasThis,
+    const std::string& self = "this"
     ) {
     if (hasThis) {
         std::string classType{getClassFromMethod(fullMethodName)};
-        if (isPrintable(classType)) {
+        if (isPrintable(classType) && self == "this") {
             wrapper << "std::string tv{escape_me(*this)};\n";
+        } else if (isPrintable(classType)) {
+            wrapper << "std::string tv{escape_me(*static_cast<const "
+                    << classType << "*>(" << self << "))};\n";
         } else {
-            wrapper << "void* tv = (void*)(this);\n";
+            wrapper << "void* tv = (void*)(" << self << ");\n";
         }
     }
 }
 
 void writeReturnValue(
-    std::ofstream& wrapper,
-    std::string& methodReturnType,
+    std::ostream& wrapper,
+    const std::string& methodReturnType,
     bool hasReturn
     ) {
     if (hasReturn) {
@@ -885,7 +1852,7 @@ void writeReturnValue(
     }
 }
 
-void writeArgsValues(std::ofstream& wrapper,
+void writeArgsValues(std::ostream& wrapper,
     std::vector<std::string>& parameterNames,
     std::vector<std::string>& parameterTypes
     ) {
@@ -917,8 +1884,8 @@ void writeArgsValues(std::ofstream& wrapper,
     wrapper << "std::string argsv{ssargs.str()};\n";
 }
 
-void writeTraceEvent(std::ofstream& wrapper,
-    std::string& fullMethodName,
+void writeTraceEvent(std::ostream& wrapper,
+    const std::string& fullMethodName,
     bool hasReturn, bool hasThis
     ) {
     wrapper << "std::stringstream ss;\n";
@@ -939,21 +1906,10 @@ void writeTraceEvent(std::ofstream& wrapper,
     //wrapper << "Tau_plugin_trace_current_timer(trace_string.c_str());\n";
 }
 
-void writeMethod(
-    std::vector<std::string> namespaceName,
-    std::vector<std::string> className,
-    std::string methodName,
-    std::string methodMangled,
-    std::string methodReturnType,
-    std::string methodType,
-    bool methodStatic,
-    std::vector<std::string> parameterNames,
-    std::vector<std::string> parameterTypes,
-    bool isConstructor = false,
-    bool isDestructor = false,
-    size_t numSpecializations = 0,
-    std::string templateType = "T",
-    std::string instanceType = "char") {
+wrapperDeclaration_t writeMethod(
+    const methodDescriptor_t& method,
+    const methodInstance_t& instance,
+    stubKind_t& kind) {
 /*
 int Secret::foo1(int a1)  {
       MARKER;
@@ -966,22 +1922,24 @@ int Secret::foo1(int a1)  {
       return retval;
   }
  */
-    validateParameterNames(parameterNames);
-    methodMangled = makeMangled(
-        namespaceName,
-        className,
-        methodName,
-        methodReturnType,
-        methodType,
-        methodStatic,
-        parameterNames,
-        parameterTypes,
-        (numSpecializations > 0), // isTemplate
-        templateType,
-        instanceType);
-    // no mangled exists?  don't need it.
-    if (methodMangled.size() == 0) {
-        return;
+    std::vector<std::string> namespaceName{names.strs(method.namespaceName)};
+    std::vector<std::string> className{names.strs(instance.className)};
+    const std::string& methodName = names.str(instance.methodName);
+    const std::string& methodMangled = instance.methodMangled;
+    const std::string& methodReturnType = names.str(instance.methodReturnType);
+    const std::string& methodType = names.str(method.methodType);
+    bool methodStatic = method.methodStatic;
+    std::vector<std::string> parameterNames{names.strs(instance.parameterNames)};
+    std::vector<std::string> parameterTypes{names.strs(instance.parameterTypes)};
+    bool isConstructor = method.isConstructor;
+    bool isDestructor = method.isDestructor;
+    size_t numSpecializations = instance.numSpecializations;
+    std::stringstream wrapper;
+    wrapper << "/* " << method.location << " */" << std::endl;
+    if (instance.matchedKey.size() > 0) {
+        wrapper << "/* Target: " << instance.signatureWithReturn << "*/\n";
+        wrapper << "/* Found:  " << instance.matchedKey << "*/\n";
+        wrapper << "/* Score:  " << instance.score << "*/\n";
     }
 
     // Write a comment header
@@ -993,9 +1951,48 @@ int Secret::foo1(int a1)  {
     wrapper << methodName << "\n";
     wrapper << _space << std::string(80,'*') << "/\n\n";
 
+    // when preloaded, the original is looked up when the wrapper is loaded,
+    // or by the wrapper if it is called before that (from another library's
+    // static constructor)
+    bool preload{get_interposition() == interpose_preload};
+    std::string realSymbol{"tau_real_" + methodMangled};
+    if (preload) {
+        wrapper << "static void * " << realSymbol << "{load_symbol<void>(\""
+                << methodMangled << "\")};\n\n";
+    }
+    // when attached at runtime, the original is looked up when attaching
+    bool got{get_interposition() == interpose_got};
+    if (got) {
+        wrapper << "static void * " << realSymbol << "{nullptr};\n\n";
+    }
+    // when linked or attached, the wrapper is a function named for the
+    // mangled name
+    bool link{get_interposition() == interpose_link};
+    bool flat{link || got};
+    std::string flatName{(link ? "__wrap_" : "tau_got_") + methodMangled};
+    bool hasThis{!methodStatic && className.size() > 0};
+    std::string self{flat ? "tau_this" : "this"};
+
+    // build a type, depending on whether the method is static.
+    std::stringstream cargs;
+    bool multiple{false};
+    if (hasThis) {
+        if (methodIsConst(methodType)) {
+            cargs << "const ";
+        }
+        cargs << "void*";
+        multiple = true;
+    }
+    for (auto p : parameterTypes) {
+        if (multiple) { cargs << ","; }
+        cargs << p;
+        multiple = true;
+    }
+    std::string ctype{methodReturnType + "(" + cargs.str() + ")"};
+
     // declare the function type, class and name
     std::stringstream ss;
-    for (size_t i = 0 ; i < numSpecializations ; i++) {
+    for (size_t i = 0 ; i < numSpecializations && !flat ; i++) {
         wrapper << "template <> ";
     }
     if (!isConstructor && !isDestructor) {
@@ -1009,7 +2006,7 @@ int Secret::foo1(int a1)  {
     // write the arguments
     std::stringstream args;
     args << "(";
-    bool multiple{false};
+    multiple = false;
     for (size_t i = 0 ; i < parameterTypes.size() ; i++) {
         if (multiple) { args << ", "; }
         args << parameterTypes[i];
@@ -1030,16 +2027,8 @@ int Secret::foo1(int a1)  {
     if (!isConstructor && !isDestructor) {
         ss2 << methodReturnType << _space;
     }
-    std::stringstream ss3;
-    for (auto ns : namespaceName ) {
-        ss3 << ns << "::";
-    }
-    for (auto cn : className ) {
-        ss3 << cn << "::";
-    }
-    ss3 << methodName;
-    std::string fullMethodName{ss3.str()};
-    ss2 << ss3.str();
+    const std::string& fullMethodName = names.str(instance.fullMethod);
+    ss2 << fullMethodName;
     ss2 << args.str();
     if (methodIsConst(methodType)) {
         ss2 << _space << _const;
@@ -1049,163 +2038,281 @@ int Secret::foo1(int a1)  {
     }
     // write the arguments
     std::string fullSignature{ss2.str()};
-    wrapper << signature << " {\n";
+    // with a profile, cheap methods get a counting wrapper, or none at all
+    kind = profile_guided() ?
+        profiledStubKind("[WRAPPER] " + fullSignature) : stub_full;
+    if (kind == stub_none) {
+        return makeDeclaration(namespaceName, "", fullSignature, methodMangled, "");
+    }
+    // with instance profiling, the timers are per object
+    bool perInstance{hasThis && instanceProfiled(getClassFromMethod(fullMethodName))};
+    if (link) {
+        wrapper << "extern \"C\" " << methodReturnType << " __real_"
+                << methodMangled << "(" << cargs.str() << ");\n\n";
+    }
+    if (flat) {
+        wrapper << "extern \"C\" " << methodReturnType << _space
+                << flatName << "(";
+        multiple = false;
+        if (hasThis) {
+            if (methodIsConst(methodType)) {
+                wrapper << "const ";
+            }
+            wrapper << "void* " << self;
+            multiple = true;
+        }
+        for (size_t i = 0 ; i < parameterTypes.size() ; i++) {
+            if (multiple) { wrapper << ", "; }
+            wrapper << parameterTypes[i] << _space << parameterNames[i];
+            multiple = true;
+        }
+        wrapper << ")";
+        if (methodIsNoexcept(methodType)) {
+            wrapper << _space << _noexcept;
+        }
+        wrapper << " {\n";
+    } else {
+        wrapper << signature << " {\n";
+    }
 
     // write a debugger line
     wrapper << "    MARKER;\n";
-    wrapper << "    const char * mangled = \"" << methodMangled << "\";\n";
+    if (!preload && !flat) {
+        wrapper << "    const char * mangled = \"" << methodMangled << "\";\n";
+    }
     // write the timer name
     wrapper << "    const char * timer_name = \"[WRAPPER] " << fullSignature << "\";\n";
-    // build a type, depending on whether the method is static.
-    std::stringstream ctype;
-    ctype << methodReturnType << "(";
-    multiple = false;
-    if (!methodStatic && className.size() > 0) {
-        if (methodIsConst(methodType)) {
-            ctype << "const ";
-        }
-        ctype << "void*";
-        multiple = true;
-    }
-    for (auto p : parameterTypes) {
-        if (multiple) { ctype << ","; }
-        ctype << p;
-        multiple = true;
-    }
-    ctype << ")";
     // declare a typedef
-    wrapper << "    using f_t = " << ctype.str() << ";\n";
+    wrapper << "    using f_t = " << ctype << ";\n";
     // get the symbol if necessary
-    wrapper << "    static f_t* f{load_symbol<f_t>(mangled)};\n";
-    wrapper << "    if (Tau_time_traced_api_call() == 1) {\n";
-    wrapper << "    Tau_traced_api_call_enter();\n";
-    // declare and start the timer
-    wrapper << "    WRAPPER(timer_name);\n";
-    /* Optionally, generate a timer exit plugin call */
-    bool do_trace = false;
-    if (configuration.count(enable_trace_plugin) > 0) {
-        do_trace = configuration[enable_trace_plugin];
-    }
-    // get the value of "this" NOW, in case the function destroys
-    // any of the arguments, including the "this" pointer.
-    // We won't be able to get it after the destructor is called.
-    if (do_trace) {
-        if (!isConstructor){
-            writeThisValue(wrapper, fullMethodName,
-                (!methodStatic && className.size() > 0));
+    if (link) {
+        wrapper << "    f_t* f{__real_" << methodMangled << "};\n";
+    } else if (preload || got) {
+        if (preload) {
+            wrapper << "    if (" << realSymbol << " == nullptr) {\n";
+            wrapper << "        " << realSymbol << " = load_symbol<void>(\""
+                    << methodMangled << "\");\n";
+            wrapper << "    }\n";
         }
-        writeArgsValues(wrapper, parameterNames, parameterTypes);
-    }
-    // call the actual function with timer
-    wrapper << "    ";
-    if (hasReturnType(methodReturnType, isConstructor, isDestructor)) {
-        wrapper << methodReturnType << " retval = ";
-    }
-    wrapper << "f(";
-    multiple = false;
-    if (!methodStatic && className.size() > 0) {
-        wrapper << "this";
-        multiple = true;
-    }
-    for (auto p : parameterNames) {
-        if (multiple) { wrapper << ", "; }
-        wrapper << p;
-        multiple = true;
+        wrapper << "    f_t* f{reinterpret_cast<f_t*>(" << realSymbol << ")};\n";
+    } else {
+        wrapper << "    static f_t* f{load_symbol<f_t>(mangled)};\n";
     }
-    wrapper << ");\n";
-    if (do_trace) {
-        // get the value of "this" NOW, in case this is a constructor!
-        // We won't be able to get it before the constructor is called.
-        if (isConstructor){
-            writeThisValue(wrapper, fullMethodName,
-                (!methodStatic && className.size() > 0));
+    if (kind == stub_count) {
+        wrapper << "    WRAPPER_COUNT(timer_name);\n";
+        wrapper << "    ";
+        if (hasReturnType(methodReturnType, isConstructor, isDestructor)) {
+            wrapper << "return ";
+        }
+        wrapper << "f(";
+        multiple = false;
+        if (hasThis) {
+            wrapper << self;
+            multiple = true;
         }
-        // get the return value now, too - it wasn't available before the call
-        writeReturnValue(wrapper, methodReturnType,
-            (hasReturnType(methodReturnType, isConstructor, isDestructor)));
-        // now build the full string and write a trace event.
-        writeTraceEvent(wrapper, fullMethodName,
-            (hasReturnType(methodReturnType, isConstructor, isDestructor)),
-            (!methodStatic && className.size() > 0));
-        wrapper << "Tau_plugin_trace_current_timer(trace_string.c_str());\n";
-    }
-    wrapper << "    Tau_traced_api_call_exit();\n";
-    if (hasReturnType(methodReturnType, isConstructor, isDestructor)) {
-        if(typeIsAddress(methodReturnType) ||
-           typeIsReference(methodReturnType) ||
-           !hasMovableReturnType(methodReturnType)) {
-            wrapper << "    return retval;\n";
+        for (auto p : parameterNames) {
+            if (multiple) { wrapper << ", "; }
+            wrapper << p;
+            multiple = true;
+        }
+        wrapper << ");\n";
+    } else {
+        wrapper << "    if (Tau_time_traced_api_call() == 1) {\n";
+        wrapper << "    Tau_traced_api_call_enter();\n";
+        // declare and start the timer
+        std::string argument{timerArgument(fullMethodName, fullSignature, parameterNames)};
+        if (argument.size() > 0) {
+            if (perInstance) {
+                std::cerr << fullSignature << " has both a timer argument and "
+                          << "instance profiling, using the timer argument." << std::endl;
+            }
+            wrapper << "    WRAPPER_VALUE(timer_name, " << argument << ");\n";
+        } else if (perInstance) {
+            wrapper << "    uint32_t tau_instance{wrap_instances::find(" << self << ")};\n";
+            wrapper << "    WRAPPER_INSTANCE(timer_name, tau_instance);\n";
         } else {
-            wrapper << "    return std::move(retval);\n";
+            wrapper << "    WRAPPER(timer_name);\n";
         }
-    }
-    wrapper << "    } else {\n";
-    wrapper << "    ";
-    if (hasReturnType(methodReturnType, isConstructor, isDestructor)) {
-        wrapper << methodReturnType << " retval = ";
-    }
-    wrapper << "f(";
-    multiple = false;
-    if (!methodStatic && className.size() > 0) {
-        //if (!isConstructor) {
-            wrapper << "this";
+        // count the call by where it came from
+        if (callSitesEnabled(fullMethodName, fullSignature)) {
+            wrapper << "    static wrap_callsites::table tauCallSites{timer_name};\n";
+            wrapper << "    tauCallSites.record(__builtin_return_address(0));\n";
+        }
+        // and time just the call, for the histogram
+        bool latency{latencyEnabled(fullMethodName, fullSignature)};
+        if (latency) {
+            wrapper << "    static wrap_latency::histogram tauLatency{timer_name};\n";
+        }
+        // and count the bytes
+        std::string bytes{volumeExpression(fullMethodName, fullSignature)};
+        if (bytes.size() > 0) {
+            wrapper << "    WRAPPER_BYTES(timer_name, " << bytes << ");\n";
+        }
+        // and correlate the deferred operations with the calls that do them
+        deferred_t deferred{deferredRole(fullMethodName, fullSignature)};
+        std::string owner{hasThis ? self : "nullptr"};
+        if (deferred == deferred_enqueue) {
+            wrapper << "    wrap_deferred::enqueue(" << owner << ", "
+                    << (bytes.size() > 0 ? bytes : "0") << ");\n";
+        } else if (deferred == deferred_flush) {
+            wrapper << "    static wrap_deferred::flush_events_t tauDeferred{"
+                    << "wrap_deferred::make_flush_events(timer_name)};\n";
+        }
+        /* Optionally, generate a timer exit plugin call */
+        bool do_trace = trace_enabled();
+        // get the value of "this" NOW, in case the function destroys
+        // any of the arguments, including the "this" pointer.
+        // We won't be able to get it after the destructor is called.
+        if (do_trace) {
+            if (!isConstructor){
+                writeThisValue(wrapper, fullMethodName, hasThis, self);
+            }
+            writeArgsValues(wrapper, parameterNames, parameterTypes);
+        }
+        // call the actual function with timer
+        if (latency) {
+            wrapper << "    uint64_t tau_start{wrap_latency::now()};\n";
+        }
+        wrapper << "    ";
+        if (hasReturnType(methodReturnType, isConstructor, isDestructor)) {
+            wrapper << methodReturnType << " retval = ";
+        }
+        wrapper << "f(";
+        multiple = false;
+        if (hasThis) {
+            wrapper << self;
             multiple = true;
-        //}
+        }
+        for (auto p : parameterNames) {
+            if (multiple) { wrapper << ", "; }
+            wrapper << p;
+            multiple = true;
+        }
+        wrapper << ");\n";
+        if (latency) {
+            wrapper << "    tauLatency.record(wrap_latency::now() - tau_start);\n";
+        }
+        if (deferred == deferred_flush) {
+            wrapper << "    wrap_deferred::flush(tauDeferred, " << owner << ");\n";
+        }
+        if (do_trace) {
+            // get the value of "this" NOW, in case this is a constructor!
+            // We won't be able to get it before the constructor is called.
+            if (isConstructor){
+                writeThisValue(wrapper, fullMethodName, hasThis, self);
+            }
+            // get the return value now, too - it wasn't available before the call
+            writeReturnValue(wrapper, methodReturnType,
+                (hasReturnType(methodReturnType, isConstructor, isDestructor)));
+            // now build the full string and write a trace event.
+            writeTraceEvent(wrapper, fullMethodName,
+                (hasReturnType(methodReturnType, isConstructor, isDestructor)),
+                (!methodStatic && className.size() > 0));
+            wrapper << "Tau_plugin_trace_current_timer(trace_string.c_str());\n";
+        }
+        wrapper << "    Tau_traced_api_call_exit();\n";
+        if (hasReturnType(methodReturnType, isConstructor, isDestructor)) {
+            if(typeIsAddress(methodReturnType) ||
+               typeIsReference(methodReturnType) ||
+               !hasMovableReturnType(methodReturnType)) {
+                wrapper << "    return retval;\n";
+            } else {
+                wrapper << "    return std::move(retval);\n";
+            }
+        }
+        wrapper << "    } else {\n";
+        wrapper << "    ";
+        if (hasReturnType(methodReturnType, isConstructor, isDestructor)) {
+            wrapper << methodReturnType << " retval = ";
+        }
+        wrapper << "f(";
+        multiple = false;
+        if (hasThis) {
+            //if (!isConstructor) {
+                wrapper << self;
+                multiple = true;
+            //}
+        }
+        for (auto p : parameterNames) {
+            if (multiple) { wrapper << ", "; }
+            wrapper << p;
+            multiple = true;
+        }
+        wrapper << ");\n";
+        if (hasReturnType(methodReturnType, isConstructor, isDestructor)) {
+            if(typeIsAddress(methodReturnType) ||
+               typeIsReference(methodReturnType) ||
+               !hasMovableReturnType(methodReturnType)) {
+                wrapper << "    return retval;\n";
+            } else {
+                wrapper << "    return std::move(retval);\n";
+            }
+        }
+        wrapper << "    }\n";
     }
-    for (auto p : parameterNames) {
-        if (multiple) { wrapper << ", "; }
-        wrapper << p;
-        multiple = true;
+    // the object is gone, another one can have its address
+    if (perInstance && isDestructor) {
+        wrapper << "    wrap_instances::release(" << self << ");\n";
     }
-    wrapper << ");\n";
-    if (hasReturnType(methodReturnType, isConstructor, isDestructor)) {
-        if(typeIsAddress(methodReturnType) ||
-           typeIsReference(methodReturnType) ||
-           !hasMovableReturnType(methodReturnType)) {
-            wrapper << "    return retval;\n";
-        } else {
-            wrapper << "    return std::move(retval);\n";
-        }
+    if (isDestructor && deferredClass(getClassFromMethod(fullMethodName))) {
+        wrapper << "    wrap_deferred::release(" << self << ");\n";
     }
-    wrapper << "    }\n";
     wrapper << "}\n\n";
+    // register the wrapper for attaching; the section holds pointers, as
+    // the compiler may pad the stubs themselves
+    if (got) {
+        wrapper << "static wrap_got::stub_t tau_stub_" << methodMangled
+                << "{\"" << methodMangled << "\", (void*)&" << flatName
+                << ", &" << realSymbol << "};\n";
+        wrapper << "static wrap_got::stub_t * tau_stub_ptr_" << methodMangled
+                << " __attribute__((used, section(\"tau_got_stubs\"))) {&tau_stub_"
+                << methodMangled << "};\n\n";
+    }
+    // group the declarations by outermost class, for sharding the output
+    std::stringstream scope;
+    for (auto ns : namespaceName ) {
+        scope << ns << "::";
+    }
+    if (className.size() > 0) {
+        scope << trimSpecialization(className[0]);
+    }
+    return makeDeclaration(namespaceName, scope.str(), fullSignature,
+        methodMangled, wrapper.str());
 }
 
-std::vector<std::string> getInstantiations() {
+stringIds_t getInstantiations() {
     auto types = configuration[template_types];
     size_t size = types.size();
-    std::vector<std::string> currentTypes;
+    stringIds_t currentTypes;
     for (size_t i = 0 ; i < size ; i++) {
         std::string tmp{types[i]};
-        currentTypes.push_back(tmp);
+        currentTypes.push_back(names.intern(tmp));
     }
     return currentTypes;
 }
 
-void writeTemplate(
-    std::vector<std::string> namespaceName,
-    std::vector<std::string> className,
-    std::vector<std::vector<std::string>> classTemplates,
-    std::string methodName,
-    std::string methodMangled,
-    std::string methodReturnType,
-    std::string methodType,
-    bool methodStatic,
-    std::vector<std::string> parameterNames,
-    std::vector<std::string> parameterTypes,
-    std::vector<std::string> templateTypes,
-    bool modifyName = true) {
+void expandTemplate(
+    const methodDescriptor_t& method,
+    std::vector<methodInstance_t>& instances) {
+    const stringIds_t& className = method.className;
+    const std::vector<stringIds_t>& classTemplates = method.classTemplates;
+    stringId_t methodName = method.methodName;
+    stringId_t methodReturnType = method.methodReturnType;
+    const stringIds_t& parameterTypes = method.parameterTypes;
+    const stringIds_t& templateTypes = method.templateTypes;
+    bool modifyName = method.modifyName;
     //std::cout << __func__ << std::endl;
     /* get the template instantiation types to be tried */
     static auto currentTypes = getInstantiations();
     static size_t numTypes = currentTypes.size();
 
     size_t numTemplates = templateTypes.size();
-    for (auto ct : classTemplates) {
+    for (auto& ct : classTemplates) {
         numTemplates += ct.size();
     }
     WRAP_ASSERT(numTemplates > 0);
     std::vector<size_t> indexes(numTemplates,0);
+    stringIds_t args;
     bool done{false};
     while (!done) {
         size_t numSpecializations = 0;
@@ -1215,70 +2322,63 @@ void writeTemplate(
         /* do replacements */
         // convert the class names
         size_t i = 0;
-        std::vector<std::string> newClassName;
+        stringIds_t newClassName;
         size_t numClass = className.size();
         for (size_t j = 0 ; j < numClass ; j++) {
-            std::stringstream ss;
-            ss << className[j];
+            stringId_t newClass{className[j]};
             if (classTemplates[j].size() > 0) {
                 numSpecializations++;
-                auto delimiter = "<";
-                for (auto t : classTemplates[j]) {
-                    ss << delimiter << currentTypes[indexes[i]];
-                    delimiter = ", ";
+                args.clear();
+                for (size_t t = 0 ; t < classTemplates[j].size() ; t++) {
+                    args.push_back(currentTypes[indexes[i]]);
                     i++;
                 }
-                ss << ">";
+                newClass = names.instantiate(className[j], args);
             }
-            std::string tmp{ss.str()};
-            newClassName.push_back(tmp);
+            newClassName.push_back(newClass);
         }
 
         // convert the function name
-        std::stringstream newName;
+        stringId_t newName{methodName};
         if (modifyName) {
-            newName << methodName;
-            auto delimiter = "<";
-            for (auto t : templateTypes) {
-                newName << delimiter << currentTypes[indexes[i]];
-                delimiter = ", ";
+            args.clear();
+            for (size_t t = 0 ; t < templateTypes.size() ; t++) {
+                args.push_back(currentTypes[indexes[i]]);
                 i++;
             }
-            newName << ">";
-        } else {
-            newName << methodName;
+            newName = names.instantiate(methodName, args);
         }
 
         /* Debug output */
 
 /*
         for (auto c : newClassName) {
-            std::cout << c << "::";
+            std::cout << names.str(c) << "::";
         }
-        std::cout << newName.str() << std::endl;
+        std::cout << names.str(newName) << std::endl;
 */
 
         /* update the types */
 
         i = 0;
-        std::string newReturnType{methodReturnType};
-        std::vector<std::string> newTypes{parameterTypes};
+        stringId_t newReturnType{methodReturnType};
+        stringIds_t newTypes{parameterTypes};
         for (size_t j = 0 ; j < numClass ; j++) {
             if (classTemplates[j].size() > 0) {
                 for (auto t : classTemplates[j]) {
                     // replace_all...
-                    bool changed = replace_all(newReturnType, t, currentTypes[indexes[i]]);
+                    stringId_t oldReturnType{newReturnType};
+                    newReturnType = names.substitute(newReturnType, t, currentTypes[indexes[i]]);
+                    bool changed = (newReturnType != oldReturnType);
                     for (size_t z = 0 ; z < newTypes.size() ; z++) {
-                        std::string np{newTypes[z]};
-                        replace_all(np, t, currentTypes[indexes[i]]);
-                        newTypes[z] = np;
+                        newTypes[z] = names.substitute(newTypes[z], t, currentTypes[indexes[i]]);
                     }
                     // if there aren't any arguments, then we must
                     // have a template return value.  Assume we do.
                     // otherwise we won't have enough "template <>"
                     if ((changed ||
-                         (contains(newReturnType, "<") &&
-                          contains(newReturnType, ">"))) &&
+                         (contains(names.str(newReturnType), "<") &&
+                          contains(names.str(newReturnType), ">"))) &&
                         (newTypes.size() < 0)) {
                         numSpecializations++;
                     }
@@ -1292,30 +2392,24 @@ void writeTemplate(
         // convert parameter template types
         for (auto t : templateTypes) {
             // replace_all...
-            replace_all(newReturnType, t, currentTypes[indexes[i]]);
+            newReturnType = names.substitute(newReturnType, t, currentTypes[indexes[i]]);
             for (size_t z = 0 ; z < newTypes.size() ; z++) {
-                std::string np{newTypes[z]};
-                replace_all(np, t, currentTypes[indexes[i]]);
-                newTypes[z] = np;
+                newTypes[z] = names.substitute(newTypes[z], t, currentTypes[indexes[i]]);
             }
             i++;
         }
 
         /* process the instantiation */
 
-        writeMethod(
-            namespaceName,
-            newClassName, // instantiated
-            newName.str(), // instantiated
-            methodMangled,
-            newReturnType, // instantiated
-            methodType,
-            methodStatic,
-            parameterNames,
-            newTypes, // instantiated
-            false, // is constructor
-            false, // is destructor
-            numSpecializations); // is template
+        methodInstance_t instance;
+        instance.className = newClassName; // instantiated
+        instance.methodName = newName; // instantiated
+        instance.methodReturnType = newReturnType; // instantiated
+        instance.parameterNames = method.parameterNames;
+        validateParameterNames(instance.parameterNames);
+        instance.parameterTypes = newTypes; // instantiated
+        instance.numSpecializations = numSpecializations; // is template
+        instances.push_back(instance);
 
         /* Advance to next instantiation permutation */
 
@@ -1338,6 +2432,196 @@ void writeTemplate(
     }
 }
 
+void expandMethod(
+    const methodDescriptor_t& method,
+    std::vector<methodInstance_t>& instances) {
+    if (method.isTemplate) {
+        expandTemplate(method, instances);
+        return;
+    }
+    methodInstance_t instance;
+    instance.className = method.className;
+    instance.methodName = method.methodName;
+    instance.methodReturnType = method.methodReturnType;
+    instance.parameterNames = method.parameterNames;
+    validateParameterNames(instance.parameterNames);
+    instance.parameterTypes = method.parameterTypes;
+    instance.numSpecializations = 0;
+    instances.push_back(instance);
+}
+
+/* Without any applications, everything that matched is wrapped */
+bool isImported(const std::string& mangled) {
+    return !pruneToImports || importedSymbols.count(mangled) > 0;
+}
+
+/* Generate the wrappers for all the methods found in the header.
+ * The methods are grouped by class, and the classes are processed in
+ * parallel.  The results are stored per method, and written in the
+ * order the methods were found, so the output is deterministic. */
+void processMethods(size_t numThreads) {
+    size_t numMethods = methodDescriptors.size();
+    std::vector<std::vector<size_t>> groups;
+    std::unordered_map<stringId_t, size_t> groupIndex;
+    for (size_t m = 0 ; m < numMethods ; m++) {
+        stringId_t key{names.qualify(methodDescriptors[m].className,
+            names.qualify(methodDescriptors[m].namespaceName))};
+        if (groupIndex.count(key) == 0) {
+            groupIndex[key] = groups.size();
+            groups.push_back(std::vector<size_t>());
+        }
+        groups[groupIndex[key]].push_back(m);
+    }
+    // biggest classes first, to balance the load
+    std::vector<size_t> order(groups.size());
+    for (size_t g = 0 ; g < groups.size() ; g++) {
+        order[g] = g;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return groups[a].size() > groups[b].size();
+    });
+    std::cout << "Generating wrappers for " << numMethods << " methods in "
+              << groups.size() << " classes using " << numThreads
+              << " threads" << std::endl;
+
+    timers.declarations = numMethods;
+    // instantiate the templates and expand the types
+    timers.begin("template expansion");
+    std::vector<std::vector<methodInstance_t>> instances(numMethods);
+    parallel_for(order, numThreads, [&](size_t g) {
+        for (auto m : groups[g]) {
+            expandMethod(methodDescriptors[m], instances[m]);
+            timers.permutations += instances[m].size();
+            for (auto& instance : instances[m]) {
+                makeSignatures(methodDescriptors[m], instance);
+            }
+        }
+    });
+
+    // claim the exact matches, in order
+    timers.begin("exact matching");
+    size_t exact{0}, canonical{0};
+    for (size_t m = 0 ; m < numMethods ; m++) {
+        for (auto& instance : instances[m]) {
+            auto start = std::chrono::steady_clock::now();
+            if (findExactMatch(instance)) {
+                instance.matchStatus = "exact";
+                exact++;
+            } else if (findCanonicalMatch(instance)) {
+                instance.matchStatus = "canonical";
+                canonical++;
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            instance.matchSeconds = elapsed.count();
+        }
+    }
+
+    // match the rest, grouped by method name
+    timers.begin("approximate matching");
+    std::vector<std::vector<methodInstance_t*>> overloads;
+    std::unordered_map<stringId_t, size_t> overloadIndex;
+    for (size_t m = 0 ; m < numMethods ; m++) {
+        for (auto& instance : instances[m]) {
+            if (instance.methodMangled.size() > 0) {
+                continue;
+            }
+            if (overloadIndex.count(instance.fullMethod) == 0) {
+                overloadIndex[instance.fullMethod] = overloads.size();
+                overloads.push_back(std::vector<methodInstance_t*>());
+            }
+            overloads[overloadIndex[instance.fullMethod]].push_back(&instance);
+        }
+    }
+    std::vector<size_t> overloadOrder(overloads.size());
+    for (size_t o = 0 ; o < overloads.size() ; o++) {
+        overloadOrder[o] = o;
+    }
+    std::stable_sort(overloadOrder.begin(), overloadOrder.end(), [&](size_t a, size_t b) {
+        return overloads[a].size() > overloads[b].size();
+    });
+    parallel_for(overloadOrder, numThreads, [&](size_t o) {
+        findApproximateMatches(overloads[o]);
+    });
+
+    // write the code
+    timers.begin("emission");
+    std::vector<std::vector<wrapperDeclaration_t>> results(numMethods);
+    // the mangled names of the wrappers actually written
+    std::vector<std::vector<std::string>> wrapped(numMethods);
+    std::atomic<size_t> counting{0}, profiledOut{0};
+    parallel_for(order, numThreads, [&](size_t g) {
+        for (auto m : groups[g]) {
+            for (auto& instance : instances[m]) {
+                // no mangled exists?  don't need it.
+                if (instance.methodMangled.size() == 0) {
+                    continue;
+                }
+                // the application never calls it?  don't need it either.
+                if (!isImported(instance.methodMangled)) {
+                    continue;
+                }
+                stubKind_t kind{stub_full};
+                wrapperDeclaration_t decl{writeMethod(methodDescriptors[m], instance, kind)};
+                // the profile says it's too cheap to wrap
+                if (kind == stub_none) {
+                    profiledOut++;
+                    continue;
+                }
+                if (kind == stub_count) {
+                    counting++;
+                }
+                results[m].push_back(decl);
+                wrapped[m].push_back(instance.methodMangled);
+            }
+        }
+    });
+    size_t approximate{0}, unmatched{0};
+    for (size_t m = 0 ; m < numMethods ; m++) {
+        for (auto& instance : instances[m]) {
+            if (instance.methodMangled.size() == 0) {
+                instance.matchStatus = "unmatched";
+                unmatched++;
+            } else if (instance.matchedKey.size() > 0) {
+                instance.matchStatus = "approximate";
+                approximate++;
+            }
+        }
+        for (auto& decl : results[m]) {
+            output.addDeclaration(decl);
+        }
+    }
+    std::cout << "Matched " << exact << " by signature, " << canonical
+              << " by canonical type, " << approximate << " approximately, "
+              << unmatched << " not found" << std::endl;
+    if (pruneToImports) {
+        std::cout << "Wrapping " << output.size() << " methods imported by the "
+                  << "application, skipped " << (exact + canonical + approximate
+                  - output.size()) << " others" << std::endl;
+    }
+    if (profile_guided()) {
+        output.setProfiled(profileDecisions);
+        std::cout << "From the profile: " << (output.size() - counting)
+                  << " timed, " << counting << " counted, " << profiledOut
+                  << " not wrapped" << std::endl;
+    }
+    timers.wrappers = output.size();
+    // the linker options that send the calls to the wrappers
+    if (get_interposition() == interpose_link) {
+        std::set<std::string> mangled;
+        for (size_t m = 0 ; m < numMethods ; m++) {
+            mangled.insert(wrapped[m].begin(), wrapped[m].end());
+        }
+        std::stringstream options;
+        for (auto& name : mangled) {
+            options << "--wrap=" << name << "\n";
+        }
+        output.addFile(output.linkOptionsFile(), options.str());
+        std::cout << "Link with -Wl,@" << output.linkOptionsFile() << std::endl;
+    }
+    timers.begin("match report");
+    writeMatchReport(instances);
+}
+
 std::string getCursorKindName( CXCursorKind cursorKind )
 {
   CXString kindName  = clang_getCursorKindSpelling( cursorKind );
@@ -1356,6 +2640,16 @@ std::string getCursorName( CXCursor cursor )
   return result;
 }
 
+std::string getCursorCanonicalType( CXCursor cursor )
+{
+  CXType cursorType = clang_getCanonicalType( clang_getCursorType( cursor ) );
+  CXString cursorString = clang_getTypeSpelling( cursorType );
+  std::string result      = clang_getCString( cursorString );
+
+  clang_disposeString( cursorString );
+  return result;
+}
+
 std::string getCursorType( CXCursor cursor )
 {
   CXType cursorType = clang_getCursorType( cursor );
@@ -1486,7 +2780,7 @@ bool isMethodDeleted(CXCursor c) {
     return false;
 }
 
-bool parseUsingAlias(CXCursor c) {
+bool parseUsingAlias(CXCursor c, stringId_t scope) {
     // get translation unit
     CXTranslationUnit unit = clang_Cursor_getTranslationUnit(c);
     // get line of location
@@ -1537,20 +2831,27 @@ bool parseUsingAlias(CXCursor c) {
     replace_all(expanded, " > ", ">");
     replace_all(expanded, " , ", ", ");
     //std::cout << std::endl << "Alias: " << alias << " = " << expanded << std::endl;
-    aliasMap.insert(std::pair<std::string,std::string>(alias,expanded));
+    aliases.add(scope, alias, expanded);
     return false;
 }
 
+/* The parser log is only written at the "full" log level.  It is written
+ * through a large buffer, and never flushed until it is closed. */
 class CursorLog {
 public:
     std::ofstream _log;
-    CursorLog() {
+    CursorLog() : _buffer(bufferSize) {
+        // has to be set before the file is opened
+        _log.rdbuf()->pubsetbuf(_buffer.data(), _buffer.size());
         _log.open("cursor.log");
         std::cout << "Writing the parser log to cursor.log" << std::endl;
     }
     ~CursorLog() {
         _log.close();
     }
+private:
+    static const size_t bufferSize = 1 << 20;
+    std::vector<char> _buffer;
 };
 
 class ASTState {
@@ -1559,12 +2860,18 @@ public:
         inClassTemplate(false), inFunctionTemplate(false) {};
     size_t depth;
     size_t inNamespace;
-    std::vector<std::string> namespaceName;
-    std::vector<std::string> className;
-    std::vector<std::string> parameterNames;
-    std::vector<std::string> parameterTypes;
-    std::vector<std::vector<std::string>> classTemplates;
-    std::vector<std::string> functionTemplates;
+    stringIds_t namespaceName;
+    stringIds_t className;
+    // the qualified name of each enclosing namespace and class
+    stringIds_t scopeName;
+    stringIds_t parameterNames;
+    stringIds_t parameterTypes;
+    stringIds_t parameterCanonicalTypes;
+    std::vector<stringIds_t> classTemplates;
+    stringIds_t functionTemplates;
+    stringId_t currentScope() {
+        return scopeName.size() > 0 ? scopeName.back() : 0;
+    }
     bool inMethod;
     bool inClassTemplate;
     bool inFunctionTemplate;
@@ -1588,6 +2895,9 @@ std::string getCursorFileLocation(CXCursor c) {
 }
 
 void printCursor(ASTState* state, CXCursorKind kind, CXCursor c) {
+    if (get_log_level() != log_full) {
+        return;
+    }
     static CursorLog log;
     if (state->inNamespace) {
         log._log << std::string(state->depth, '-');
@@ -1599,9 +2909,9 @@ void printCursor(ASTState* state, CXCursorKind kind, CXCursor c) {
                      << getCursorType(c)
                      << "]";
         }
-        log._log << getCursorFileLocation(c) << std::endl;
+        log._log << getCursorFileLocation(c) << '\n';
     }
-    std::cout << "." << std::flush;
+    std::cout << ".";
 }
 
 CXChildVisitResult traverse(CXCursor c, CXCursor parent, CXClientData clientData);
@@ -1611,184 +2921,186 @@ void handleNamespace(CXCursor c, CXCursorKind kind, ASTState* state) {
         state->inNamespace = true;
     }
     if (state->inNamespace) {
-        wrapper << "namespace " << getCursorName(c) << " {\n\n";
-        state->namespaceName.push_back(getCursorName(c));
+        stringId_t name{names.intern(getCursorName(c))};
+        state->namespaceName.push_back(name);
+        state->scopeName.push_back(names.qualify(state->currentScope(), name));
         printCursor(state, kind, c);
         clang_visitChildren(c, traverse, state);
         if ((getCursorName(c) == mainNamespace)) {
             state->inNamespace = false;
         }
-        wrapper << "} // end namespace "
-                << getCursorName(c) << "\n\n";
         state->namespaceName.pop_back();
+        state->scopeName.pop_back();
     }
 }
 
-bool skipThisClass(ASTState* state) {
-    static auto classes = configuration[skip_classes];
-    size_t size = classes.size();
-    std::stringstream ss;
-    std::string delimiter{""};
-    for (auto c : state->namespaceName) {
-        ss << delimiter << c;
-        delimiter = "::";
-    }
-    for (auto c : state->className) {
-        ss << delimiter << c;
+std::set<stringId_t> loadSkipList(const std::string& key) {
+    std::set<stringId_t> skipped;
+    if (configuration.count(key) > 0) {
+        for (auto c : configuration[key]) {
+            std::string tmp{c};
+            skipped.insert(names.intern(tmp));
+        }
     }
-    std::string fullName{ss.str()};
-    std::cout << std::endl << "Found Class: " << fullName;
-    for (size_t i = 0 ; i < size ; i++) {
-        std::string tmp{classes[i]};
-        if (fullName.compare(tmp) == 0) {
+    return skipped;
+}
+
+bool skipThisClass(ASTState* state) {
+    static std::set<stringId_t> classes{loadSkipList(skip_classes)};
+    stringId_t fullName{state->currentScope()};
+    bool verbose{get_log_level() != log_off};
+    if (verbose) {
+        std::cout << std::endl << "Found Class: " << names.str(fullName);
+    }
+    if (classes.count(fullName) > 0) {
+        if (verbose) {
             std::cout << " (skipped)";
-            return true;
         }
+        return true;
     }
     return false;
 }
 
-bool skipThisMethod(ASTState* state, std::string methodName) {
-    static auto classes = configuration[skip_methods];
-    size_t size = classes.size();
-    std::stringstream ss;
-    for (auto c : state->namespaceName) {
-        ss << c << "::";
-    }
-    for (auto c : state->className) {
-        ss << c << "::";
-    }
-    ss << methodName;
-    std::string fullName{ss.str()};
-    //std::cout << fullName << std::endl;
-    for (size_t i = 0 ; i < size ; i++) {
-        std::string tmp{classes[i]};
-        if (fullName.compare(tmp) == 0) {
-            std::cout << std::endl << " " << fullName << "() (skipped)";
-            return true;
+bool skipThisMethod(ASTState* state, stringId_t methodName) {
+    static std::set<stringId_t> methods{loadSkipList(skip_methods)};
+    stringId_t fullName{names.qualify(state->currentScope(), methodName)};
+    //std::cout << names.str(fullName) << std::endl;
+    if (methods.count(fullName) > 0) {
+        if (get_log_level() != log_off) {
+            std::cout << std::endl << " " << names.str(fullName) << "() (skipped)";
         }
+        return true;
     }
     return false;
 }
 
 void handleClass(CXCursor c, CXCursorKind kind, ASTState* state) {
-    state->className.push_back(getCursorName(c));
-    std::vector<std::string> classTemplates;
+    stringId_t name{names.intern(getCursorName(c))};
+    state->className.push_back(name);
+    state->scopeName.push_back(names.qualify(state->currentScope(), name));
+    stringIds_t classTemplates;
     state->classTemplates.push_back(classTemplates);
     printCursor(state, kind, c);
     if (!skipThisClass(state)) {
         clang_visitChildren(c, traverse, state);
     }
     state->className.pop_back();
+    state->scopeName.pop_back();
     state->classTemplates.pop_back();
 }
 
 void handleClassTemplate(CXCursor c, CXCursorKind kind, ASTState* state) {
     state->inClassTemplate = true;
-    state->className.push_back(getCursorName(c));
-    std::vector<std::string> classTemplates;
+    stringId_t name{names.intern(getCursorName(c))};
+    state->className.push_back(name);
+    state->scopeName.push_back(names.qualify(state->currentScope(), name));
+    stringIds_t classTemplates;
     state->classTemplates.push_back(classTemplates);
     printCursor(state, kind, c);
     if (!skipThisClass(state)) {
         clang_visitChildren(c, traverse, state);
     }
     state->className.pop_back();
+    state->scopeName.pop_back();
     state->inClassTemplate = false;
     state->classTemplates.pop_back();
 }
 
 void handleMethod(CXCursor c, CXCursorKind kind, ASTState* state, bool isConstructor, bool isDestructor) {
-    std::string methodName = getCursorName(c);
-    std::string methodMangled = getCursorMangled(c);
-    std::string methodType = getCursorType(c);
-    std::string methodReturnType = getCursorReturnType(c);
+    stringId_t methodName = names.intern(getCursorName(c));
+    stringId_t methodType = names.intern(getCursorType(c));
+    stringId_t methodReturnType = names.intern(getCursorReturnType(c));
     bool methodStatic = getCursorStatic(c);
     state->inMethod = true;
     state->parameterNames.clear();
     state->parameterTypes.clear();
+    state->parameterCanonicalTypes.clear();
     state->functionTemplates.clear();
 
     if (!skipThisMethod(state, methodName)) {
         printCursor(state, kind, c);
-        wrapper << "/* " << getCursorFileLocation(c) << " */" << std::endl;
+        std::string location{getCursorFileLocation(c)};
         clang_visitChildren(c, traverse, state);
+        //methodReturnType = validateReturnType(c, state->namespaceName, methodName, methodReturnType);
+        methodDescriptor_t method;
+        method.namespaceName = state->namespaceName;
+        method.className = state->className;
+        method.classTemplates = state->classTemplates;
+        method.methodName = methodName;
+        method.methodReturnType = methodReturnType;
+        method.methodType = methodType;
+        method.methodStatic = methodStatic;
+        method.parameterNames = state->parameterNames;
+        method.parameterTypes = state->parameterTypes;
+        method.parameterCanonicalTypes = state->parameterCanonicalTypes;
+        method.templateTypes = state->functionTemplates;
+        method.location = location;
         if (state->inClassTemplate) {
-            //methodReturnType = validateReturnType(c, state->namespaceName, methodName, methodReturnType);
-            writeTemplate(
-                state->namespaceName,
-                state->className,
-                state->classTemplates,
-                methodName,
-                methodMangled,
-                methodReturnType,
-                methodType,
-                methodStatic,
-                state->parameterNames,
-                state->parameterTypes,
-                state->functionTemplates,
-                false);
+            method.isConstructor = false;
+            method.isDestructor = false;
+            method.isTemplate = true;
         } else {
-            //methodReturnType = validateReturnType(c, state->namespaceName, methodName, methodReturnType);
-            writeMethod(
-                state->namespaceName,
-                state->className,
-                methodName,
-                methodMangled,
-                methodReturnType,
-                methodType,
-                methodStatic,
-                state->parameterNames,
-                state->parameterTypes,
-                isConstructor,
-                isDestructor,
-                0); // num template specializations
+            method.isConstructor = isConstructor;
+            method.isDestructor = isDestructor;
+            method.isTemplate = false;
         }
+        method.modifyName = false;
+        methodDescriptors.push_back(method);
     }
     state->inMethod = false;
     state->parameterNames.clear();
     state->parameterTypes.clear();
+    state->parameterCanonicalTypes.clear();
     state->functionTemplates.clear();
 }
 
 void handleFunctionTemplate(CXCursor c, CXCursorKind kind, ASTState* state) {
-    std::string methodName = getCursorName(c);
-    std::string methodMangled = getCursorMangled(c);
-    std::string methodType = getCursorType(c);
-    std::string methodReturnType = getCursorReturnType(c);
+    stringId_t methodName = names.intern(getCursorName(c));
+    stringId_t methodType = names.intern(getCursorType(c));
+    stringId_t methodReturnType = names.intern(getCursorReturnType(c));
     bool methodStatic = getCursorStatic(c);
     state->inMethod = true;
     state->inFunctionTemplate = true;
     state->parameterNames.clear();
     state->parameterTypes.clear();
+    state->parameterCanonicalTypes.clear();
     state->functionTemplates.clear();
 
     if (!skipThisMethod(state, methodName)) {
         printCursor(state, kind, c);
-        wrapper << "/* " << getCursorFileLocation(c) << " */" << std::endl;
+        std::string location{getCursorFileLocation(c)};
         clang_visitChildren(c, traverse, state);
-        writeTemplate(
-            state->namespaceName,
-            state->className,
-            state->classTemplates,
-            methodName,
-            methodMangled,
-            methodReturnType,
-            methodType,
-            methodStatic,
-            state->parameterNames,
-            state->parameterTypes,
-            state->functionTemplates);
+        methodDescriptor_t method;
+        method.namespaceName = state->namespaceName;
+        method.className = state->className;
+        method.classTemplates = state->classTemplates;
+        method.methodName = methodName;
+        method.methodReturnType = methodReturnType;
+        method.methodType = methodType;
+        method.methodStatic = methodStatic;
+        method.parameterNames = state->parameterNames;
+        method.parameterTypes = state->parameterTypes;
+        method.parameterCanonicalTypes = state->parameterCanonicalTypes;
+        method.templateTypes = state->functionTemplates;
+        method.location = location;
+        method.isConstructor = false;
+        method.isDestructor = false;
+        method.isTemplate = true;
+        method.modifyName = true;
+        methodDescriptors.push_back(method);
     }
     state->inMethod = false;
     state->inFunctionTemplate = false;
     //std::cout << "end template: " << getCursorName(c) << std::endl;
     state->parameterNames.clear();
     state->parameterTypes.clear();
+    state->parameterCanonicalTypes.clear();
     state->functionTemplates.clear();
 }
 
 CXChildVisitResult traverse(CXCursor c, CXCursor parent, CXClientData clientData)
 {
+    timers.cursors++;
     ASTState* state = (ASTState*)(clientData);
     state->depth++;
 
@@ -1844,17 +3156,18 @@ CXChildVisitResult traverse(CXCursor c, CXCursor parent, CXClientData clientData
         handleFunctionTemplate(c, kind, state);
     }
     else if (kind == CXCursorKind::CXCursor_ParmDecl && state->inMethod && state->inNamespace) {
-        state->parameterNames.push_back(getCursorName(c));
-        state->parameterTypes.push_back(getCursorType(c));
+        state->parameterNames.push_back(names.intern(getCursorName(c)));
+        state->parameterTypes.push_back(names.intern(getCursorType(c)));
+        state->parameterCanonicalTypes.push_back(names.intern(getCursorCanonicalType(c)));
     }
     else if (kind == CXCursorKind::CXCursor_TemplateTypeParameter) {
         // handle "enable_if" cases
         if (getCursorName(c) != "Enable") {
             if (state->inFunctionTemplate) {
-                state->functionTemplates.push_back(getCursorName(c)); // or type, same thing
+                state->functionTemplates.push_back(names.intern(getCursorName(c))); // or type, same thing
             } else {
                 size_t index = state->className.size() - 1;
-                state->classTemplates[index].push_back(getCursorName(c)); // or type, same thing
+                state->classTemplates[index].push_back(names.intern(getCursorName(c))); // or type, same thing
             }
             printCursor(state, kind, c);
         }
@@ -1864,7 +3177,7 @@ CXChildVisitResult traverse(CXCursor c, CXCursor parent, CXClientData clientData
     }
     else if (kind == CXCursorKind::CXCursor_TypeAliasDecl) {
         printCursor(state, kind, c);
-        parseUsingAlias(c);
+        parseUsingAlias(c, state->currentScope());
     } else {
         printCursor(state, kind, c);
     }
@@ -1895,6 +3208,14 @@ void printDiagnostics(CXTranslationUnit translationUnit){
     }
 }
 
+void collectInclusion(CXFile includedFile, CXSourceLocation* inclusionStack,
+    unsigned includeLength, CXClientData clientData) {
+    CXString cursorString = clang_getFileName( includedFile );
+    std::string filename = clang_getCString( cursorString );
+    clang_disposeString( cursorString );
+    includedFiles.push_back(filename);
+}
+
 void parse_header(const std::string& filename) {
     if( access( filename.c_str(), F_OK ) != 0 ) {
         // file doesn't exist
@@ -1913,6 +3234,7 @@ void parse_header(const std::string& filename) {
         std::string flag{flags[i]};
         arguments[i] = strdup(flag.c_str());
     }
+    timers.begin("header parse");
     CXTranslationUnit unit = clang_parseTranslationUnit(
             index,
             filename.c_str(),
@@ -1927,9 +3249,15 @@ void parse_header(const std::string& filename) {
         exit(-1);
     }
 
+    includedFiles.clear();
+    clang_getInclusions(unit, collectInclusion, nullptr);
+
+    timers.begin("traversal");
     CXCursor cursor = clang_getTranslationUnitCursor(unit);
     ASTState state;
     clang_visitChildren(cursor, traverse, &state);
+    // aliases can use other aliases, expand them now
+    aliases.build();
 }
 
 void parse_symbols(std::string libname) {
@@ -1938,9 +3266,21 @@ void parse_symbols(std::string libname) {
         std::cerr << "Error: " << libname << " not found." << std::endl;
         exit(-1);
     }
+    // nm reads archives too, but only the linker can interpose on them
+    if (ends_with(libname, ".a") && get_interposition() != interpose_link) {
+        std::cerr << "Warning: " << libname << " is a static archive, "
+                  << "use \"interposition\": \"link\" to wrap it." << std::endl;
+    }
+    // the symbol log is only written at the "full" log level
+    bool logging{get_log_level() == log_full};
+    std::vector<char> logBuffer;
     std::ofstream symbolLog;
-    symbolLog.open("symbol.log", std::fstream::out | std::fstream::app);
-    std::cout << "Writing the library symbol log to cursor.log" << std::endl;
+    if (logging) {
+        logBuffer.resize(1 << 20);
+        symbolLog.rdbuf()->pubsetbuf(logBuffer.data(), logBuffer.size());
+        symbolLog.open("symbol.log", std::fstream::out | std::fstream::app);
+        std::cout << "Writing the library symbol log to symbol.log" << std::endl;
+    }
     // call `nm libsecret.so | grep " [TW] " | grep "_Z"` and capture output
     std::stringstream ss;
     ss << "nm " << libname << R"( | grep " [TW] " | grep "_Z" | grep )" << mainNamespace;
@@ -1952,21 +3292,29 @@ void parse_symbols(std::string libname) {
     char * line = nullptr;
     size_t len = 0;
     ssize_t read;
+    double demangleSeconds{0.0};
     while ((read = getline(&line, &len, symbols)) != -1) {
         std::string tmp{line};
         std::string last_element(tmp.substr(tmp.rfind(_space)));
         last_element.erase(remove_if(last_element.begin(), last_element.end(), isspace), last_element.end());
-        symbolLog << last_element << std::endl;
+        if (logging) {
+            symbolLog << last_element << '\n';
+        }
         size_t buff_size = 128; // not long enough, but it'll get reallocated if necessary
         auto buf = reinterpret_cast<char*>(std::malloc(buff_size));
         int stat = 0;
+        auto start = std::chrono::steady_clock::now();
         buf = abi::__cxa_demangle(last_element.c_str(), buf, &buff_size, &stat);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        demangleSeconds += elapsed.count();
         if (stat != 0) {
             free(buf);
             continue;
         }
         std::string demangled(buf);
         free(buf);
+        // before the fixes below, normalizing handles those
+        std::string signatureKey{normalizeSignature(demangled)};
         std::string needle{mainNamespace+"::"};
         // if this symbol isn't in our namespace, don't track it
         if (demangled.find(needle) == std::string::npos) {
@@ -2006,22 +3354,73 @@ void parse_symbols(std::string libname) {
         symbolData_t result;
         result.nArgs = count;
         result.mangledName = last_element;
-        symbolLog<< " has " << count << " arguments" << std::endl;
-        symbolLog << demangled << std::endl;
+        result.signatureKey = signatureKey;
+        if (token_alignment()) {
+            result.tokens = alignmentTokens(demangled);
+        }
+        if (logging) {
+            symbolLog << " has " << count << " arguments\n";
+            symbolLog << demangled << '\n';
+        }
         symbolMap.insert(std::pair<std::string,symbolData_t>(demangled, result));
+        timers.symbols++;
     }
     pclose(symbols);
-    symbolLog.close();
+    if (logging) {
+        symbolLog.close();
+    }
+    timers.accumulate("demangle", demangleSeconds);
     // demangle, and put the results into the map
 }
 
+/* The undefined symbols in the namespace, which the application (or shared
+ * library, or object file) gets from the library being wrapped */
+void parse_imports(std::string appname) {
+    if( access( appname.c_str(), F_OK ) != 0 ) {
+        // file doesn't exist
+        std::cerr << "Error: " << appname << " not found." << std::endl;
+        exit(-1);
+    }
+    // executables and shared libraries import from the dynamic symbol table
+    bool objects{ends_with(appname, ".o") || ends_with(appname, ".a")};
+    std::stringstream ss;
+    ss << "nm " << (objects ? "" : "-D ") << "--undefined-only " << appname
+       << R"( | grep "_Z" | grep )" << mainNamespace;
+    std::string command{ss.str()};
+    std::cout << "Parsing imported symbols in namespace " << mainNamespace
+              << " from " << appname << std::endl;
+    FILE * symbols = popen(command.c_str(),"r");
+    char * line = nullptr;
+    size_t len = 0;
+    ssize_t read;
+    size_t count{0};
+    while ((read = getline(&line, &len, symbols)) != -1) {
+        std::string tmp{line};
+        std::string last_element(tmp.substr(tmp.rfind(_space)));
+        last_element.erase(remove_if(last_element.begin(), last_element.end(), isspace), last_element.end());
+        // versioned dynamic symbols end with @VERSION
+        size_t at = last_element.find('@');
+        if (at != std::string::npos) {
+            last_element = last_element.substr(0, at);
+        }
+        if (importedSymbols.insert(last_element).second) {
+            count++;
+        }
+    }
+    free(line);
+    pclose(symbols);
+    std::cout << "Found " << count << " imported symbols" << std::endl;
+}
+
 /* -------------------------------------------------------------------------- */
 /* -- Instrument the program using C, C++ or F90 instrumentation routines --- */
 /* -------------------------------------------------------------------------- */
 int main(int argc, char **argv)
 {
     std::vector<std::string> libNames;
+    std::vector<std::string> appNames;
     std::string configFile("");
+    size_t numThreads = defaultThreadCount();
 
     if (argc < 2) {
         show_usage(argv[0]);
@@ -2044,18 +3443,95 @@ int main(int argc, char **argv)
             configFile = std::string(argv[i+1]);
             std::cout << "Configuration file to be used: " << configFile << std::endl;
         }
+        else if (strcmp(argv[i], "-j") == 0) {
+            numThreads = std::max(atoi(argv[i+1]), 1);
+            std::cout << "Threads to be used: " << numThreads << std::endl;
+        }
+        else if (strcmp(argv[i], "-a") == 0) {
+            appNames.push_back(std::string(argv[i+1]));
+            std::cout << "Application to wrap for: " << argv[i+1] << std::endl;
+        }
     }
 
+    timers.begin("configuration");
     readConfigFile(configFile);
+    read_profile();
+    if (configuration.count(output_shards) > 0) {
+        size_t shards = configuration[output_shards];
+        output.setShards(shards);
+    }
+    std::string cacheDirectory{""};
+    if (configuration.count(result_cache) > 0) {
+        std::string tmp{configuration[result_cache]};
+        cacheDirectory = tmp;
+    }
+    ResultCache cache(cacheDirectory);
+    if (cacheDirectory.size() > 0) {
+        cache.addInput("version", tau_wrap_version);
+        cache.addBinary("/proc/self/exe");
+        cache.addInput("header", headerName);
+        cache.addInput("namespace", mainNamespace);
+        cache.addInput("configuration", configuration.dump());
+        for(auto lib : libNames) {
+            cache.addBinary(lib);
+        }
+        for(auto app : appNames) {
+            cache.addBinary(app);
+        }
+        // the profile can change without its name changing
+        for(auto profile : read_profile_files()) {
+            cache.addBinary(profile);
+        }
+        for(auto& decision : earlierDecisions) {
+            cache.addInput(decision.first, decision.second);
+        }
+        timers.begin("result cache");
+        if (cache.restore()) {
+            std::cout << "Inputs unchanged, restored library wrapper from "
+                      << cacheDirectory << std::endl;
+            if (get_log_level() != log_off) {
+                timers.report(std::cout);
+            }
+            return 0;
+        }
+    }
     writePreamble(headerName, libNames);
-    std::remove("symbols.log");
+    std::remove("symbol.log");
+    timers.begin("symbols");
     for(auto lib : libNames) {
         parse_symbols(lib);
     }
+    for(auto app : appNames) {
+        parse_imports(app);
+    }
+    pruneToImports = appNames.size() > 0;
+    indexSymbols();
     parse_header(headerName);
-    wrapper.close();
-    std::cout << std::endl;
-    std::cout << "Wrote library wrapper to wr.cpp" << std::endl;
+    if (get_log_level() != log_off) {
+        std::cout << std::endl;
+    }
+    processMethods(numThreads);
+    timers.begin("output");
+    output.write();
+    if (output.getShards() > 1) {
+        std::cout << "Wrote library wrapper to " << output.mainFile()
+                  << ", " << output.commonFile() << " and "
+                  << output.getShards() << " shards" << std::endl;
+    } else {
+        std::cout << "Wrote library wrapper to " << output.mainFile() << std::endl;
+    }
+    if (cacheDirectory.size() > 0) {
+        std::vector<std::string> outputs{output.files()};
+        outputs.push_back(output.manifestFile());
+        if (match_report_file().size() > 0) {
+            outputs.push_back(match_report_file());
+        }
+        timers.begin("result cache");
+        cache.store(includedFiles, outputs);
+    }
+    if (get_log_level() != log_off) {
+        timers.report(std::cout);
+    }
 } /* end of main */
 
 /* EOF */
@@ -0,0 +1,50 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ****************************************************************************/
+
+/* A minimal pool of worker threads for the generator.  Tasks are handed
+ * out one at a time from a shared counter, so a thread that finishes a
+ * cheap task immediately picks up the next one, and the expensive tasks
+ * don't leave the other threads idle.  Callers store results by task
+ * index, so the output order never depends on the number of threads. */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+inline size_t defaultThreadCount() {
+    size_t count = std::thread::hardware_concurrency();
+    return (count > 0) ? count : 1;
+}
+
+/* Call fn(order[i]) for every i, using up to numThreads threads.
+ * Put the most expensive tasks first in the order for the best balance. */
+inline void parallel_for(const std::vector<size_t>& order, size_t numThreads,
+    std::function<void(size_t)> fn) {
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next.fetch_add(1)) < order.size()) {
+            fn(order[i]);
+        }
+    };
+    if (numThreads > order.size()) {
+        numThreads = order.size();
+    }
+    // the calling thread does its share, too
+    std::vector<std::thread> threads;
+    for (size_t t = 1 ; t < numThreads ; t++) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto& t : threads) {
+        t.join();
+    }
+}
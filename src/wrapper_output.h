@@ -0,0 +1,306 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ****************************************************************************/
+
+/* Collects the generated wrapper declarations and writes them to disk.
+ * Every declaration is hashed, and the hashes are recorded in a manifest
+ * next to the generated source.  Declarations can be spread over several
+ * "shard" source files, keyed by their outermost class, so that when the
+ * library changes only the shards whose declarations changed are rewritten.
+ * Files with unchanged content are never touched, so their modification
+ * times are preserved and make (or ccache) can skip them. */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include "json.h"
+
+/* 64-bit FNV-1a hash, stable across runs and platforms */
+inline uint64_t contentHash(const std::string& s,
+    uint64_t hash = 14695981039346656037ULL) {
+    for (size_t i = 0 ; i < s.size() ; i++) {
+        hash ^= (unsigned char)(s[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+inline std::string hashToString(uint64_t hash) {
+    char tmp[17];
+    snprintf(tmp, sizeof(tmp), "%016llx", (unsigned long long)hash);
+    std::string result{tmp};
+    return result;
+}
+
+/* Read a whole file into a string, returns false if it can't be read */
+inline bool readWholeFile(const std::string& filename, std::string& contents) {
+    std::ifstream in(filename, std::ifstream::in | std::ifstream::binary);
+    if (!in.good()) {
+        return false;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    contents = ss.str();
+    return true;
+}
+
+/* Write the file only if the content differs from what is on disk */
+inline bool writeIfChanged(const std::string& filename, const std::string& contents) {
+    std::string existing;
+    if (readWholeFile(filename, existing) && existing == contents) {
+        return false;
+    }
+    std::ofstream out(filename, std::ofstream::out | std::ofstream::binary);
+    out << contents;
+    out.close();
+    return true;
+}
+
+typedef struct wrapperDeclaration {
+    std::vector<std::string> namespaceName;
+    // the outermost class (or empty for free functions), used to pick a shard
+    std::string scope;
+    // the signature and mangled name, unique for each declaration
+    std::string key;
+    std::string text;
+    uint64_t hash;
+} wrapperDeclaration_t;
+
+inline wrapperDeclaration_t makeDeclaration(
+    const std::vector<std::string>& namespaceName,
+    const std::string& scope, const std::string& signature,
+    const std::string& mangled, const std::string& text) {
+    wrapperDeclaration_t decl;
+    decl.namespaceName = namespaceName;
+    decl.scope = scope;
+    decl.key = signature + " " + mangled;
+    decl.text = text;
+    // the emitted text covers all the configuration-dependent bits
+    decl.hash = contentHash(text, contentHash(decl.key));
+    return decl;
+}
+
+class WrapperOutput {
+public:
+    WrapperOutput() : _baseName("wr"), _numShards(1) {}
+    void setShards(size_t numShards) {
+        _numShards = (numShards > 1) ? numShards : 1;
+    }
+    size_t getShards() { return _numShards; }
+    void setPreamble(const std::string& preamble) { _preamble = preamble; }
+    /* extra source that goes at the end of the main file (not a shard) */
+    void addEpilogue(const std::string& text) { _epilogue << text; }
+    void addDeclaration(const wrapperDeclaration_t& decl) {
+        _declarations.push_back(decl);
+    }
+    size_t size() { return _declarations.size(); }
+    std::string mainFile() { return _baseName + ".cpp"; }
+    std::string commonFile() { return _baseName + "_common.h"; }
+    std::string manifestFile() { return _baseName + ".manifest"; }
+    std::string linkOptionsFile() { return _baseName + ".link"; }
+    /* another generated file (not source), written along with the others */
+    void addFile(const std::string& filename, const std::string& contents) {
+        _extraFiles[filename] = contents;
+    }
+    std::string shardFile(size_t index) {
+        std::stringstream ss;
+        ss << _baseName << "_" << index << ".cpp";
+        std::string tmp{ss.str()};
+        return tmp;
+    }
+    /* The object the Makefiles build from a source file (wr_3.cpp -> wr_3.o) */
+    std::string objectFile(const std::string& file) {
+        size_t dot = file.rfind(".cpp");
+        if (dot == std::string::npos || dot + 4 != file.size()) {
+            return "";
+        }
+        return file.substr(0, dot) + ".o";
+    }
+    /* Which shard does this scope belong to? Stable across runs, so adding
+     * a method to a class only changes the shard holding that class. */
+    size_t shardOf(const std::string& scope) {
+        return (size_t)(contentHash(scope) % _numShards);
+    }
+    /* The decisions of profile guided generation, by timer name, from the
+     * manifest of the previous generation and for this one */
+    std::map<std::string, std::string> previousProfiled();
+    void setProfiled(const std::map<std::string, std::string>& profiled) {
+        _profiled = profiled;
+    }
+    /* the list of files written by the last call to write() */
+    std::vector<std::string>& files() { return _files; }
+    void write();
+private:
+    std::string _baseName;
+    size_t _numShards;
+    std::string _preamble;
+    std::stringstream _epilogue;
+    std::vector<wrapperDeclaration_t> _declarations;
+    std::vector<std::string> _files;
+    std::map<std::string, std::string> _extraFiles;
+    std::map<std::string, std::string> _profiled;
+    void writeDeclarations(std::ostream& out, size_t shard, bool allShards);
+};
+
+/* Write the declarations, opening and closing namespaces as needed */
+inline void WrapperOutput::writeDeclarations(std::ostream& out, size_t shard,
+    bool allShards) {
+    std::vector<std::string> current;
+    for (auto& decl : _declarations) {
+        if (!allShards && shardOf(decl.scope) != shard) {
+            continue;
+        }
+        // how much of the namespace is shared with the previous declaration?
+        size_t common = 0;
+        while (common < current.size() &&
+               common < decl.namespaceName.size() &&
+               current[common] == decl.namespaceName[common]) {
+            common++;
+        }
+        while (current.size() > common) {
+            out << "} // end namespace " << current.back() << "\n\n";
+            current.pop_back();
+        }
+        for (size_t i = common ; i < decl.namespaceName.size() ; i++) {
+            out << "namespace " << decl.namespaceName[i] << " {\n\n";
+            current.push_back(decl.namespaceName[i]);
+        }
+        out << decl.text;
+    }
+    while (current.size() > 0) {
+        out << "} // end namespace " << current.back() << "\n\n";
+        current.pop_back();
+    }
+}
+
+inline std::map<std::string, std::string> WrapperOutput::previousProfiled() {
+    using json = nlohmann::json;
+    std::map<std::string, std::string> profiled;
+    std::string tmp;
+    if (!readWholeFile(manifestFile(), tmp)) {
+        return profiled;
+    }
+    try {
+        json previous = json::parse(tmp);
+        if (previous.count("profiled") > 0) {
+            for (auto it = previous["profiled"].begin() ;
+                 it != previous["profiled"].end() ; ++it) {
+                std::string decision{it.value()};
+                profiled[it.key()] = decision;
+            }
+        }
+    } catch (...) {
+        std::cerr << "Ignoring unreadable " << manifestFile() << std::endl;
+    }
+    return profiled;
+}
+
+inline void WrapperOutput::write() {
+    using json = nlohmann::json;
+    // read the previous manifest, if there is one
+    json previous;
+    std::string tmp;
+    if (readWholeFile(manifestFile(), tmp)) {
+        try {
+            previous = json::parse(tmp);
+        } catch (...) {
+            std::cerr << "Ignoring unreadable " << manifestFile() << std::endl;
+        }
+    }
+    std::map<std::string, std::string> contents;
+    if (_numShards == 1) {
+        std::stringstream ss;
+        ss << _preamble;
+        writeDeclarations(ss, 0, true);
+        ss << _epilogue.str();
+        contents[mainFile()] = ss.str();
+    } else {
+        contents[commonFile()] = "#pragma once\n" + _preamble;
+        std::stringstream ss;
+        ss << "#include \"" << commonFile() << "\"\n\n";
+        ss << _epilogue.str();
+        contents[mainFile()] = ss.str();
+        for (size_t i = 0 ; i < _numShards ; i++) {
+            std::stringstream shard;
+            shard << "#include \"" << commonFile() << "\"\n\n";
+            writeDeclarations(shard, i, false);
+            contents[shardFile(i)] = shard.str();
+        }
+    }
+    for (auto& kv : _extraFiles) {
+        contents[kv.first] = kv.second;
+    }
+    // build the new manifest, and compare declarations with the old one
+    json manifest;
+    manifest["shards"] = _numShards;
+    if (!_profiled.empty()) {
+        manifest["profiled"] = _profiled;
+    }
+    size_t added{0}, changed{0}, removed{0};
+    std::set<std::string> seen;
+    for (auto& decl : _declarations) {
+        std::string hash{hashToString(decl.hash)};
+        std::string file{_numShards == 1 ? mainFile() : shardFile(shardOf(decl.scope))};
+        json entry;
+        entry["hash"] = hash;
+        entry["file"] = file;
+        manifest["declarations"][decl.key] = entry;
+        seen.insert(decl.key);
+        if (previous.count("declarations") == 0 ||
+            previous["declarations"].count(decl.key) == 0) {
+            added++;
+        } else if (previous["declarations"][decl.key]["hash"] != hash) {
+            changed++;
+        }
+    }
+    if (previous.count("declarations") > 0) {
+        for (auto it = previous["declarations"].begin() ;
+             it != previous["declarations"].end() ; ++it) {
+            if (seen.count(it.key()) == 0) {
+                removed++;
+            }
+        }
+    }
+    // write the files that changed, leave the others alone
+    size_t rewritten{0};
+    _files.clear();
+    for (auto& kv : contents) {
+        manifest["files"][kv.first] = hashToString(contentHash(kv.second));
+        if (writeIfChanged(kv.first, kv.second)) {
+            rewritten++;
+        }
+        _files.push_back(kv.first);
+    }
+    // remove any files from a previous run that we no longer produce, and
+    // the objects built from them, so that they don't get linked
+    if (previous.count("files") > 0) {
+        for (auto it = previous["files"].begin() ;
+             it != previous["files"].end() ; ++it) {
+            if (contents.count(it.key()) == 0) {
+                std::remove(it.key().c_str());
+                std::string object{objectFile(it.key())};
+                if (!object.empty()) {
+                    std::remove(object.c_str());
+                }
+            }
+        }
+    }
+    writeIfChanged(manifestFile(), manifest.dump(2) + "\n");
+    std::cout << "Declarations: " << _declarations.size() << " ("
+              << added << " added, " << changed << " changed, "
+              << removed << " removed)" << std::endl;
+    std::cout << "Rewrote " << rewritten << " of " << contents.size()
+              << " generated files" << std::endl;
+}
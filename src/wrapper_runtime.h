@@ -0,0 +1,1447 @@
+/****************************************************************************
+ **  TAU Portable Profiling Package                                        **
+ **  http://tau.uoregon.edu                                                **
+ ****************************************************************************
+ **  Copyright 2021                                                        **
+ **  Department of Computer and Information Science, University of Oregon  **
+ ****************************************************************************/
+
+/* Code written into the generated wrapper for the backends other than TAU,
+ * and for the interposition modes that need more than a few lines.
+ * The generated methods call the same functions whatever the backend
+ * (Tau_time_traced_api_call(), Tau_traced_api_call_enter() and _exit(),
+ * Tau_plugin_trace_current_timer() and the WRAPPER macro), so each backend
+ * only has to provide those.  Everything here is inline, so the wrapper
+ * can be split into shards that all include it. */
+
+#pragma once
+
+/* The builtin profiler.  Each thread keeps a call count and inclusive and
+ * exclusive time (from clock_gettime) for every timer, and the count, sum,
+ * minimum and maximum of the values of every event, and a flat profile per
+ * thread and for all threads is written to wrapper_profile.<pid>.txt
+ * (or $WRAPPER_PROFILE_PREFIX.<pid>.txt) at exit.  The thread data is never
+ * freed, so threads that exit early are still in the profile. */
+constexpr const char * builtinProfiler = R"(
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+
+namespace wrap_profiler {
+
+inline uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Only the owning thread changes a counter, so it doesn't need an atomic
+ * increment, only one that can be read safely by the exit handler */
+inline void add(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+        std::memory_order_relaxed);
+}
+
+typedef struct measurement {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> inclusive{0};
+    std::atomic<uint64_t> exclusive{0};
+    std::atomic<uint64_t> bytes{0};
+    measurement() {}
+    measurement(const measurement& m) :
+        calls(m.calls.load(std::memory_order_relaxed)),
+        inclusive(m.inclusive.load(std::memory_order_relaxed)),
+        exclusive(m.exclusive.load(std::memory_order_relaxed)),
+        bytes(m.bytes.load(std::memory_order_relaxed)) {}
+} measurement_t;
+
+typedef struct event_stats {
+    uint64_t count;
+    double sum;
+    double min;
+    double max;
+} event_stats_t;
+
+typedef struct frame {
+    size_t timer;
+    uint64_t start;
+    uint64_t children;
+} frame_t;
+
+/* Only the thread itself changes its timers and events, but they can be
+ * read at exit by another thread while it is still running, so the thread
+ * holds the lock when it grows the timers, and when it triggers an event,
+ * which is rare. */
+typedef struct thread_profile {
+    size_t id;
+    std::mutex lock;
+    std::vector<measurement_t> timers;
+    std::vector<event_stats_t> events;
+    std::vector<frame_t> stack;
+    int traced_depth;
+} thread_profile_t;
+
+class profiler {
+public:
+    size_t add_timer(const char * name) {
+        std::lock_guard<std::mutex> guard(_lock);
+        _names.push_back(name);
+        return _names.size() - 1;
+    }
+    size_t add_event(const char * name) {
+        std::lock_guard<std::mutex> guard(_lock);
+        _eventNames.push_back(name);
+        return _eventNames.size() - 1;
+    }
+    thread_profile_t * add_thread() {
+        std::lock_guard<std::mutex> guard(_lock);
+        thread_profile_t * t = new thread_profile_t();
+        t->id = _threads.size();
+        t->traced_depth = 0;
+        _threads.push_back(t);
+        return t;
+    }
+    void write() {
+        std::lock_guard<std::mutex> guard(_lock);
+        const char * prefix = getenv("WRAPPER_PROFILE_PREFIX");
+        char filename[1024];
+        snprintf(filename, sizeof(filename), "%s.%d.txt",
+            prefix == nullptr ? "wrapper_profile" : prefix, (int)getpid());
+        FILE * out = fopen(filename, "w");
+        if (out == nullptr) {
+            perror(filename);
+            return;
+        }
+        std::vector<measurement_t> total(_names.size());
+        std::vector<event_stats_t> totalEvents(_eventNames.size(), event_stats_t{0,0.0,0.0,0.0});
+        for (auto t : _threads) {
+            std::unique_lock<std::mutex> threadGuard(t->lock);
+            std::vector<measurement_t> timers(t->timers);
+            std::vector<event_stats_t> events(t->events);
+            threadGuard.unlock();
+            fprintf(out, "Thread %zu:\n", t->id);
+            write_flat(out, timers);
+            write_events(out, events);
+            for (size_t i = 0 ; i < events.size() ; i++) {
+                merge(totalEvents[i], events[i]);
+            }
+            for (size_t i = 0 ; i < timers.size() ; i++) {
+                add(total[i].calls, timers[i].calls);
+                add(total[i].inclusive, timers[i].inclusive);
+                add(total[i].exclusive, timers[i].exclusive);
+                add(total[i].bytes, timers[i].bytes);
+            }
+        }
+        fprintf(out, "Total (%zu threads):\n", _threads.size());
+        write_flat(out, total);
+        write_events(out, totalEvents);
+        fclose(out);
+    }
+    static void merge(event_stats_t& into, const event_stats_t& from) {
+        if (from.count == 0) {
+            return;
+        }
+        into.min = (into.count == 0 || from.min < into.min) ? from.min : into.min;
+        into.max = (into.count == 0 || from.max > into.max) ? from.max : into.max;
+        into.count += from.count;
+        into.sum += from.sum;
+    }
+private:
+    std::mutex _lock;
+    std::vector<std::string> _names;
+    std::vector<std::string> _eventNames;
+    std::vector<thread_profile_t*> _threads;
+    /* One line per timer that was called, most exclusive time first, then
+     * the data volume and throughput of the timers that have any */
+    void write_flat(FILE * out, const std::vector<measurement_t>& timers) {
+        std::vector<size_t> order;
+        uint64_t exclusive{0};
+        bool volume{false};
+        for (size_t i = 0 ; i < timers.size() ; i++) {
+            if (timers[i].calls > 0) {
+                order.push_back(i);
+                exclusive += timers[i].exclusive;
+                volume = volume || timers[i].bytes > 0;
+            }
+        }
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return timers[a].exclusive > timers[b].exclusive;
+        });
+        fprintf(out, "%6s %14s %14s %12s %12s  %s\n", "%Time", "Exclusive ms",
+            "Inclusive ms", "#Call", "usec/call", "Name");
+        for (auto i : order) {
+            const measurement_t& m = timers[i];
+            fprintf(out, "%6.1f %14.3f %14.3f %12llu %12.3f  %s\n",
+                exclusive > 0 ? 100.0 * m.exclusive / exclusive : 0.0,
+                m.exclusive / 1.0e6, m.inclusive / 1.0e6,
+                (unsigned long long)m.calls, m.inclusive / 1.0e3 / m.calls,
+                _names[i].c_str());
+        }
+        fprintf(out, "\n");
+        if (!volume) {
+            return;
+        }
+        fprintf(out, "%14s %12s %12s  %s\n", "Bytes", "Bytes/call", "MB/s", "Name");
+        for (auto i : order) {
+            const measurement_t& m = timers[i];
+            if (m.bytes > 0) {
+                fprintf(out, "%14llu %12.1f %12.3f  %s\n", (unsigned long long)m.bytes,
+                    (double)m.bytes / m.calls,
+                    m.inclusive > 0 ? m.bytes * 1.0e3 / m.inclusive : 0.0,
+                    _names[i].c_str());
+            }
+        }
+        fprintf(out, "\n");
+    }
+    /* One line per event that was triggered */
+    void write_events(FILE * out, const std::vector<event_stats_t>& events) {
+        bool any{false};
+        for (size_t i = 0 ; i < events.size() ; i++) {
+            if (events[i].count == 0) {
+                continue;
+            }
+            if (!any) {
+                fprintf(out, "%12s %14s %14s %14s %14s  %s\n", "#Samples",
+                    "Mean", "Min", "Max", "Total", "Event");
+                any = true;
+            }
+            const event_stats_t& e = events[i];
+            fprintf(out, "%12llu %14.3f %14.3f %14.3f %14.3f  %s\n",
+                (unsigned long long)e.count, e.sum / e.count, e.min, e.max,
+                e.sum, _eventNames[i].c_str());
+        }
+        if (any) {
+            fprintf(out, "\n");
+        }
+    }
+};
+
+/* Never destroyed, the profile is written by an exit handler */
+inline profiler& instance() {
+    static profiler * p{nullptr};
+    static std::once_flag once;
+    std::call_once(once, []() {
+        p = new profiler();
+        atexit([]() { instance().write(); });
+    });
+    return *p;
+}
+
+inline thread_profile_t& this_thread() {
+    static thread_local thread_profile_t * t{instance().add_thread()};
+    return *t;
+}
+
+class scoped_timer {
+public:
+    scoped_timer(size_t timer) : _thread(this_thread()) {
+        if (_thread.timers.size() <= timer) {
+            std::lock_guard<std::mutex> guard(_thread.lock);
+            _thread.timers.resize(timer + 1);
+        }
+        _thread.stack.push_back(frame_t{timer, now(), 0});
+    }
+    ~scoped_timer() {
+        frame_t f = _thread.stack.back();
+        _thread.stack.pop_back();
+        uint64_t elapsed = now() - f.start;
+        measurement_t& m = _thread.timers[f.timer];
+        add(m.calls, 1);
+        add(m.inclusive, elapsed);
+        add(m.exclusive, elapsed - f.children);
+        if (!_thread.stack.empty()) {
+            _thread.stack.back().children += elapsed;
+        }
+    }
+private:
+    thread_profile_t& _thread;
+};
+
+inline void trigger(size_t event, double value) {
+    thread_profile_t& t = this_thread();
+    std::lock_guard<std::mutex> guard(t.lock);
+    if (t.events.size() <= event) {
+        t.events.resize(event + 1, event_stats_t{0,0.0,0.0,0.0});
+    }
+    profiler::merge(t.events[event], event_stats_t{1, value, value, value});
+}
+
+/* For the wrappers that measure data volume */
+inline void add_bytes(size_t timer, uint64_t bytes) {
+    add(this_thread().timers[timer].bytes, bytes);
+}
+
+/* For the wrappers that only count the calls */
+inline void count(size_t timer) {
+    thread_profile_t& t = this_thread();
+    if (t.timers.size() <= timer) {
+        std::lock_guard<std::mutex> guard(t.lock);
+        t.timers.resize(timer + 1);
+    }
+    add(t.timers[timer].calls, 1);
+}
+
+} // namespace wrap_profiler
+
+/* Only the outermost wrapped call is timed, like with TAU */
+inline int Tau_time_traced_api_call() {
+    return wrap_profiler::this_thread().traced_depth == 0 ? 1 : 0;
+}
+
+inline void Tau_traced_api_call_enter() {
+    wrap_profiler::this_thread().traced_depth++;
+}
+
+inline void Tau_traced_api_call_exit() {
+    wrap_profiler::this_thread().traced_depth--;
+}
+)";
+
+/* Trace events from the builtin profiler are written as JSON lines to
+ * wrapper_trace.<pid>.json */
+constexpr const char * builtinTraceFunction = R"(
+inline void Tau_plugin_trace_current_timer(const char * name) {
+    static std::mutex lock;
+    static FILE * out{nullptr};
+    std::lock_guard<std::mutex> guard(lock);
+    if (out == nullptr) {
+        char filename[64];
+        snprintf(filename, sizeof(filename), "wrapper_trace.%d.json", (int)getpid());
+        out = fopen(filename, "w");
+        if (out == nullptr) {
+            return;
+        }
+    }
+    fprintf(out, "{%s}\n", name);
+}
+)";
+
+constexpr const char * builtinMacro = R"(
+#define WRAPPER(name) \
+  static size_t tauFI{wrap_profiler::instance().add_timer(name)}; \
+  wrap_profiler::scoped_timer tauFProf(tauFI);
+)";
+
+constexpr const char * builtinCountMacro = R"(
+#define WRAPPER_COUNT(name) \
+  static size_t tauFI{wrap_profiler::instance().add_timer(name)}; \
+  wrap_profiler::count(tauFI);
+)";
+
+/* Runtime attach and detach.  Each wrapper is registered in the
+ * tau_got_stubs section (as a pointer to its stub), with the mangled name
+ * it wraps and where to keep the address of the original.  Attaching looks
+ * up the originals, then goes through the relocations of every loaded
+ * object (except the wrapper itself) and points the GOT entries for the
+ * wrapped names at the wrappers.  Detaching puts back what was there
+ * before.  Calls already in progress finish normally, and function
+ * pointers the application took before attaching aren't affected.  The
+ * patched objects are kept loaded until detaching, so that an object
+ * closed in the meantime isn't unmapped under the entries to restore;
+ * objects opened after attaching are only patched by attaching again. */
+constexpr const char * gotPatcher = R"(
+#include <link.h>
+#include <elf.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <dlfcn.h>
+#include <mutex>
+#include <unordered_map>
+
+#if defined(__x86_64__)
+#define TAU_GOT_JUMP_SLOT R_X86_64_JUMP_SLOT
+#define TAU_GOT_GLOB_DAT R_X86_64_GLOB_DAT
+#elif defined(__aarch64__)
+#define TAU_GOT_JUMP_SLOT R_AARCH64_JUMP_SLOT
+#define TAU_GOT_GLOB_DAT R_AARCH64_GLOB_DAT
+#elif defined(__powerpc64__)
+#define TAU_GOT_JUMP_SLOT R_PPC64_JMP_SLOT
+#define TAU_GOT_GLOB_DAT R_PPC64_GLOB_DAT
+#elif defined(__i386__)
+#define TAU_GOT_JUMP_SLOT R_386_JMP_SLOT
+#define TAU_GOT_GLOB_DAT R_386_GLOB_DAT
+#else
+#error "Runtime attach is not supported on this architecture"
+#endif
+
+#if __WORDSIZE == 64
+#define TAU_GOT_R_SYM(info) ELF64_R_SYM(info)
+#define TAU_GOT_R_TYPE(info) ELF64_R_TYPE(info)
+#else
+#define TAU_GOT_R_SYM(info) ELF32_R_SYM(info)
+#define TAU_GOT_R_TYPE(info) ELF32_R_TYPE(info)
+#endif
+
+namespace wrap_got {
+
+typedef struct stub {
+    const char * mangled;
+    void * wrapper;
+    void ** original;
+} stub_t;
+
+} // namespace wrap_got
+
+/* The bounds of the stub table, from the linker.  Weak, because there is
+ * no section (and the linker doesn't define them) when no method was
+ * wrapped. */
+extern "C" {
+extern wrap_got::stub_t * __start_tau_got_stubs[] __attribute__((weak));
+extern wrap_got::stub_t * __stop_tau_got_stubs[] __attribute__((weak));
+}
+
+namespace wrap_got {
+
+typedef struct patch {
+    void ** slot;
+    void * previous;
+    bool relro;
+} patch_t;
+
+typedef struct state {
+    std::mutex lock;
+    std::unordered_map<std::string, stub_t*> stubs;
+    std::vector<patch_t> patches;
+    /* The patched objects, by name, with the handles that keep them loaded */
+    std::unordered_map<std::string, void*> pinned;
+    /* The objects attach() opened for patching, not (yet) needed */
+    std::unordered_map<std::string, void*> opened;
+} state_t;
+
+/* Never destroyed, detaching at unload happens after static destructors */
+inline state_t& get_state() {
+    static state_t * s{new state_t()};
+    return *s;
+}
+
+/* Write a GOT entry, which may be in a read-only (RELRO) page.  Only the
+ * whole pages of the RELRO segment are made read-only by the loader, so
+ * that's what they go back to. */
+inline bool write_slot(void ** slot, void * value, bool relro) {
+    if (relro) {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        void * start = (void*)((uintptr_t)slot & ~(uintptr_t)(page - 1));
+        if (mprotect(start, page, PROT_READ | PROT_WRITE) != 0) {
+            return false;
+        }
+        *slot = value;
+        mprotect(start, page, PROT_READ);
+    } else {
+        *slot = value;
+    }
+    return true;
+}
+
+typedef struct object {
+    ElfW(Addr) base;
+    ElfW(Addr) relro_start;
+    ElfW(Addr) relro_end;
+    const ElfW(Sym) * symtab;
+    const char * strtab;
+} object_t;
+
+template<class R>
+void patch_relocations(state_t& s, const object_t& o, const R * relocations, size_t size) {
+    if (relocations == nullptr) {
+        return;
+    }
+    for (size_t i = 0 ; i < size / sizeof(R) ; i++) {
+        size_t type = TAU_GOT_R_TYPE(relocations[i].r_info);
+        if (type != TAU_GOT_JUMP_SLOT && type != TAU_GOT_GLOB_DAT) {
+            continue;
+        }
+        const char * name = o.strtab + o.symtab[TAU_GOT_R_SYM(relocations[i].r_info)].st_name;
+        auto found = s.stubs.find(name);
+        if (found == s.stubs.end()) {
+            continue;
+        }
+        ElfW(Addr) address = o.base + relocations[i].r_offset;
+        void ** slot = (void**)address;
+        if (*slot == found->second->wrapper) {
+            continue;
+        }
+        bool relro = address >= o.relro_start && address < o.relro_end;
+        void * previous = *slot;
+        if (write_slot(slot, found->second->wrapper, relro)) {
+            s.patches.push_back(patch_t{slot, previous, relro});
+        }
+    }
+}
+
+inline int list_object(struct dl_phdr_info * info, size_t, void * data) {
+    std::vector<std::string>& names = *(std::vector<std::string>*)data;
+    if (info->dlpi_name != nullptr && info->dlpi_name[0] != '\0') {
+        names.push_back(info->dlpi_name);
+    }
+    return 0;
+}
+
+inline int patch_object(struct dl_phdr_info * info, size_t, void * data) {
+    state_t& s = *(state_t*)data;
+    // the program itself (which has no name) is never unloaded, anything
+    // else has to be opened first, to keep it loaded
+    std::string name{info->dlpi_name == nullptr ? "" : info->dlpi_name};
+    auto opened = s.opened.find(name);
+    if (!name.empty() && opened == s.opened.end()) {
+        return 0;
+    }
+    object_t o{info->dlpi_addr, 0, 0, nullptr, nullptr};
+    const ElfW(Dyn) * dynamic{nullptr};
+    ElfW(Addr) self = (ElfW(Addr))(&patch_object);
+    for (int i = 0 ; i < info->dlpi_phnum ; i++) {
+        const ElfW(Phdr)& p = info->dlpi_phdr[i];
+        ElfW(Addr) start = info->dlpi_addr + p.p_vaddr;
+        if (p.p_type == PT_LOAD && self >= start && self < start + p.p_memsz) {
+            // don't patch the wrapper itself
+            return 0;
+        } else if (p.p_type == PT_DYNAMIC) {
+            dynamic = (const ElfW(Dyn)*)start;
+        } else if (p.p_type == PT_GNU_RELRO) {
+            // the partial page at the end stays writable
+            ElfW(Addr) page = (ElfW(Addr))sysconf(_SC_PAGESIZE);
+            o.relro_start = start & ~(page - 1);
+            o.relro_end = (start + p.p_memsz) & ~(page - 1);
+        }
+    }
+    if (dynamic == nullptr) {
+        return 0;
+    }
+    const void * jmprel{nullptr};
+    const void * rela{nullptr};
+    const void * rel{nullptr};
+    size_t jmprelSize{0}, relaSize{0}, relSize{0};
+    ElfW(Sxword) pltrel{DT_RELA};
+    for (const ElfW(Dyn) * d = dynamic ; d->d_tag != DT_NULL ; d++) {
+        // most loaders relocate these in place, but not all
+        ElfW(Addr) ptr = d->d_un.d_ptr;
+        if (ptr < o.base) {
+            ptr += o.base;
+        }
+        switch (d->d_tag) {
+            case DT_SYMTAB: o.symtab = (const ElfW(Sym)*)ptr; break;
+            case DT_STRTAB: o.strtab = (const char*)ptr; break;
+            case DT_JMPREL: jmprel = (const void*)ptr; break;
+            case DT_PLTRELSZ: jmprelSize = d->d_un.d_val; break;
+            case DT_PLTREL: pltrel = d->d_un.d_val; break;
+            case DT_RELA: rela = (const void*)ptr; break;
+            case DT_RELASZ: relaSize = d->d_un.d_val; break;
+            case DT_REL: rel = (const void*)ptr; break;
+            case DT_RELSZ: relSize = d->d_un.d_val; break;
+            default: break;
+        }
+    }
+    if (o.symtab == nullptr || o.strtab == nullptr) {
+        return 0;
+    }
+    size_t before = s.patches.size();
+    if (pltrel == DT_RELA) {
+        patch_relocations(s, o, (const ElfW(Rela)*)jmprel, jmprelSize);
+    } else {
+        patch_relocations(s, o, (const ElfW(Rel)*)jmprel, jmprelSize);
+    }
+    patch_relocations(s, o, (const ElfW(Rela)*)rela, relaSize);
+    patch_relocations(s, o, (const ElfW(Rel)*)rel, relSize);
+    if (!name.empty() && s.patches.size() > before && s.pinned.count(name) == 0) {
+        s.pinned[name] = opened->second;
+        s.opened.erase(opened);
+    }
+    return 0;
+}
+
+/* Returns the number of GOT entries pointed at the wrappers */
+inline int attach() {
+    state_t& s = get_state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    if (s.stubs.empty() && __start_tau_got_stubs != nullptr) {
+        for (stub_t ** entry = __start_tau_got_stubs ; entry < __stop_tau_got_stubs ; entry++) {
+            stub_t * stub = *entry;
+            *(stub->original) = dlsym(RTLD_DEFAULT, stub->mangled);
+            if (*(stub->original) == nullptr) {
+                std::cerr << "Error obtaining symbol " << stub->mangled
+                          << " from libraries!" << std::endl;
+                continue;
+            }
+            s.stubs[stub->mangled] = stub;
+        }
+    }
+    // open the objects first (they can't be opened while iterating), and
+    // close the ones that weren't patched, or that were already kept open
+    std::vector<std::string> names;
+    dl_iterate_phdr(list_object, &names);
+    for (auto& name : names) {
+        void * handle = dlopen(name.c_str(), RTLD_LAZY | RTLD_NOLOAD);
+        if (handle != nullptr) {
+            s.opened[name] = handle;
+        }
+    }
+    size_t before = s.patches.size();
+    dl_iterate_phdr(patch_object, &s);
+    for (auto& opened : s.opened) {
+        dlclose(opened.second);
+    }
+    s.opened.clear();
+    return (int)(s.patches.size() - before);
+}
+
+/* Returns the number of GOT entries restored */
+inline int detach() {
+    state_t& s = get_state();
+    std::lock_guard<std::mutex> guard(s.lock);
+    int restored{0};
+    for (auto p = s.patches.rbegin() ; p != s.patches.rend() ; ++p) {
+        if (write_slot(p->slot, p->previous, p->relro)) {
+            restored++;
+        }
+    }
+    s.patches.clear();
+    for (auto& pinned : s.pinned) {
+        dlclose(pinned.second);
+    }
+    s.pinned.clear();
+    return restored;
+}
+
+} // namespace wrap_got
+)";
+
+/* The entry points for attaching, in the main file only.  The wrapper
+ * attaches when it is loaded unless TAU_WRAP_ATTACH=0, and detaches when
+ * it is unloaded. */
+constexpr const char * gotEntryPoints = R"(
+extern "C" int tau_wrap_attach() {
+    return wrap_got::attach();
+}
+
+extern "C" int tau_wrap_detach() {
+    return wrap_got::detach();
+}
+
+__attribute__((constructor)) static void tau_wrap_load() {
+    const char * attach = getenv("TAU_WRAP_ATTACH");
+    if (attach == nullptr || strcmp(attach, "0") != 0) {
+        tau_wrap_attach();
+    }
+}
+
+__attribute__((destructor)) static void tau_wrap_unload() {
+    tau_wrap_detach();
+}
+)";
+
+/* Per-instance profiling.  Objects are given compact ids, in the order
+ * they are first seen (by their constructor wrapper, or any other wrapper
+ * if the constructor wasn't wrapped), and forgotten by their destructor
+ * wrapper.  Ids aren't reused, and once TAU_WRAP_INSTANCE_LIMIT objects
+ * have been seen every new one goes in the overflow bucket, id 0.  The
+ * table of live objects is open addressing with linear probing, without
+ * locks: slots are claimed with compare-and-swap and emptied by marking
+ * them deleted, and never reused, so there can't be more deleted slots
+ * than ids.  The id is given after the slot is claimed, and the other
+ * threads that find the object in the meantime wait for it. */
+constexpr const char * instanceTable = R"(
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+namespace wrap_instances {
+
+constexpr uintptr_t empty{0};
+constexpr uintptr_t deleted{1};
+/* A power of two, at least four times the limit */
+constexpr size_t capacity(size_t size = 64) {
+    return size >= 4 * TAU_WRAP_INSTANCE_LIMIT ? size : capacity(size * 2);
+}
+
+/* The id of a slot that was claimed but doesn't have one yet is 0 */
+constexpr uint32_t overflow{UINT32_MAX};
+
+typedef struct slot {
+    std::atomic<uintptr_t> key;
+    std::atomic<uint32_t> id;
+} slot_t;
+
+inline slot_t * table() {
+    static slot_t slots[capacity()];
+    return slots;
+}
+
+inline size_t hash(uintptr_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (size_t)key & (capacity() - 1);
+}
+
+inline uint32_t ready(slot_t& slot, uint32_t id) {
+    slot.id.store(id, std::memory_order_release);
+    return id == overflow ? 0 : id;
+}
+
+/* The thread that claimed the slot may still be giving it its id */
+inline uint32_t wait(slot_t& slot) {
+    uint32_t id;
+    while ((id = slot.id.load(std::memory_order_acquire)) == 0) {
+        std::this_thread::yield();
+    }
+    return id == overflow ? 0 : id;
+}
+
+/* The id of the object, giving it one if it doesn't have one yet */
+inline uint32_t find(const void * object) {
+    static std::atomic<uint32_t> next{1};
+    uintptr_t key = (uintptr_t)object;
+    slot_t * slots = table();
+    size_t i = hash(key);
+    for (size_t probes = 0 ; probes < capacity() ; probes++) {
+        uintptr_t current = slots[i].key.load(std::memory_order_acquire);
+        if (current == key) {
+            return wait(slots[i]);
+        }
+        if (current == empty) {
+            break;
+        }
+        i = (i + 1) & (capacity() - 1);
+    }
+    if (next.load(std::memory_order_relaxed) > TAU_WRAP_INSTANCE_LIMIT) {
+        return 0;
+    }
+    // claim the first empty slot from where the search stopped
+    for (size_t probes = 0 ; probes < capacity() ; probes++) {
+        uintptr_t expected{empty};
+        if (slots[i].key.compare_exchange_strong(expected, key)) {
+            uint32_t id = next.fetch_add(1);
+            return ready(slots[i], id > TAU_WRAP_INSTANCE_LIMIT ? overflow : id);
+        }
+        // another thread is giving the same object its id
+        if (expected == key) {
+            return wait(slots[i]);
+        }
+        i = (i + 1) & (capacity() - 1);
+    }
+    return 0;
+}
+
+inline void release(const void * object) {
+    uintptr_t key = (uintptr_t)object;
+    slot_t * slots = table();
+    size_t i = hash(key);
+    for (size_t probes = 0 ; probes < capacity() ; probes++) {
+        uintptr_t current = slots[i].key.load(std::memory_order_acquire);
+        if (current == key) {
+            slots[i].key.compare_exchange_strong(current, deleted);
+            return;
+        }
+        if (current == empty) {
+            return;
+        }
+        i = (i + 1) & (capacity() - 1);
+    }
+}
+
+inline std::string timer_name(const char * name, uint32_t id) {
+    std::string tmp{name};
+    if (id == 0) {
+        return tmp + " [instance overflow]";
+    }
+    return tmp + " [instance " + std::to_string(id) + "]";
+}
+
+} // namespace wrap_instances
+)";
+
+constexpr const char * builtinInstanceMacro = R"(
+namespace wrap_instances {
+
+/* The timer for an id, kept plus one (0 is none yet), and added by the
+ * first thread to get here while the others wait for it */
+inline size_t timer(std::atomic<size_t>& slot, const char * name, uint32_t id) {
+    constexpr size_t adding{SIZE_MAX};
+    size_t current = slot.load(std::memory_order_acquire);
+    if (current == 0 && slot.compare_exchange_strong(current, adding)) {
+        current = wrap_profiler::instance().add_timer(timer_name(name, id).c_str()) + 1;
+        slot.store(current, std::memory_order_release);
+    }
+    while (current == adding) {
+        std::this_thread::yield();
+        current = slot.load(std::memory_order_acquire);
+    }
+    return current - 1;
+}
+
+} // namespace wrap_instances
+
+#define WRAPPER_INSTANCE(name, id) \
+  static std::atomic<size_t> tauFIs[TAU_WRAP_INSTANCE_LIMIT + 1]; \
+  size_t tauFI = wrap_instances::timer(tauFIs[id], name, id); \
+  wrap_profiler::scoped_timer tauFProf(tauFI);
+)";
+
+/* Data volume.  The configuration gives an expression for the number of
+ * bytes each call moves, in terms of the parameters, using these helpers
+ * (i.e. "wrap_volume::bytes(values)" or "wrap_volume::bytes(data, count)"
+ * or "wrap_volume::elements(variable.Count()) * sizeof(T)"). */
+constexpr const char * volumeHelpers = R"(
+namespace wrap_volume {
+
+template<class T> size_t bytes(const std::vector<T>& values) {
+    return values.size() * sizeof(T);
+}
+
+inline size_t bytes(const std::string& value) {
+    return value.size();
+}
+
+template<class T> size_t bytes(const T *, size_t count) {
+    return count * sizeof(T);
+}
+
+inline size_t bytes(const void *, size_t count) {
+    return count;
+}
+
+template<class D> size_t elements(const D& dims) {
+    size_t count{1};
+    for (auto d : dims) {
+        count *= d;
+    }
+    return count;
+}
+
+/* For a variable templated on its element type, i.e. adios2::Variable<T>:
+ * the elements in its selection (Count()) times the size of an element.
+ * The wrappers are explicit specializations, where T isn't declared, so
+ * the element type is deduced from the parameter. */
+template<template<class...> class V, class T, class... Rest>
+size_t count_bytes(const V<T, Rest...>& variable) {
+    return elements(variable.Count()) * sizeof(T);
+}
+
+} // namespace wrap_volume
+)";
+
+/* The builtin profiler adds the bytes to the timer, the throughput is
+ * written with the profile */
+constexpr const char * builtinVolumeMacro = R"(
+#define WRAPPER_BYTES(name, bytes) \
+  wrap_profiler::add_bytes(tauFI, bytes);
+)";
+
+/* Events (a value per sample, with the count, mean, minimum and maximum
+ * reported) for the builtin profiler.  The TAU backend has its own, on top
+ * of TAU user events. */
+constexpr const char * builtinEvents = R"(
+typedef size_t wrap_event_t;
+
+inline wrap_event_t wrap_event(const std::string& name) {
+    return wrap_profiler::instance().add_event(name.c_str());
+}
+
+inline void wrap_trigger(wrap_event_t event, double value) {
+    wrap_profiler::trigger(event, value);
+}
+)";
+
+/* Deferred operations.  Enqueue wrappers record the start time (and the
+ * bytes, if the method has a data volume) of each operation, by the object
+ * it was called on.  When a flush wrapper returns, the pending operations
+ * of the same object are taken, and the queue depth, the latency from each
+ * enqueue to the end of the flush and the bytes flushed are sent to the
+ * flush method's events.  The destructor wrapper of the class drops what
+ * is still pending, so that another object at the same address doesn't
+ * inherit it. */
+constexpr const char * deferredTracker = R"deferred(
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+
+namespace wrap_deferred {
+
+inline uint64_t now() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+typedef struct operation {
+    uint64_t start;
+    uint64_t bytes;
+} operation_t;
+
+typedef struct flush_events {
+    wrap_event_t depth;
+    wrap_event_t latency;
+    wrap_event_t bytes;
+} flush_events_t;
+
+inline flush_events_t make_flush_events(const char * name) {
+    std::string tmp{name};
+    return flush_events_t{wrap_event(tmp + " : Queue depth"),
+        wrap_event(tmp + " : Enqueue to flush latency (us)"),
+        wrap_event(tmp + " : Bytes flushed")};
+}
+
+class tracker {
+public:
+    void enqueue(const void * owner, uint64_t bytes) {
+        uint64_t start = now();
+        std::lock_guard<std::mutex> guard(_lock);
+        _pending[owner].push_back(operation_t{start, bytes});
+    }
+    std::vector<operation_t> take(const void * owner) {
+        std::vector<operation_t> operations;
+        std::lock_guard<std::mutex> guard(_lock);
+        auto found = _pending.find(owner);
+        if (found != _pending.end()) {
+            operations.swap(found->second);
+        }
+        return operations;
+    }
+    void drop(const void * owner) {
+        std::lock_guard<std::mutex> guard(_lock);
+        _pending.erase(owner);
+    }
+private:
+    std::mutex _lock;
+    std::unordered_map<const void *, std::vector<operation_t>> _pending;
+};
+
+/* Never destroyed, operations can be flushed from exit handlers */
+inline tracker& instance() {
+    static tracker * t{new tracker()};
+    return *t;
+}
+
+inline void enqueue(const void * owner, uint64_t bytes) {
+    instance().enqueue(owner, bytes);
+}
+
+inline void release(const void * owner) {
+    instance().drop(owner);
+}
+
+inline void flush(const flush_events_t& events, const void * owner) {
+    std::vector<operation_t> operations{instance().take(owner)};
+    uint64_t end = now();
+    uint64_t bytes{0};
+    for (auto& o : operations) {
+        wrap_trigger(events.latency, (end - o.start) / 1.0e3);
+        bytes += o.bytes;
+    }
+    wrap_trigger(events.depth, (double)operations.size());
+    wrap_trigger(events.bytes, (double)bytes);
+}
+
+} // namespace wrap_deferred
+)deferred";
+
+/* Timers chosen by the value of an argument.  Each wrapper keeps a small
+ * open addressing table from the value (as a string) to its timer, without
+ * locks: the slot for a new value is claimed with compare-and-swap before
+ * its timer is created, so that each timer is created once, and threads
+ * that want the same value meanwhile wait for it.  Entries are never
+ * removed.  After TAU_WRAP_VALUE_LIMIT values the rest share one overflow
+ * timer. */
+constexpr const char * valueTimers = R"values(
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <sstream>
+
+namespace wrap_values {
+
+inline const std::string& key(const std::string& value) {
+    return value;
+}
+
+inline std::string key(const char * value) {
+    return value == nullptr ? "(null)" : value;
+}
+
+template<class T> std::string key(const T& value) {
+    std::stringstream ss;
+    ss << value;
+    return ss.str();
+}
+
+inline std::string timer_name(const char * name, const std::string& label) {
+    return std::string(name) + " [" + label + "]";
+}
+
+/* A power of two, at least twice the limit */
+constexpr size_t capacity(size_t size = 16) {
+    return size >= 2 * TAU_WRAP_VALUE_LIMIT ? size : capacity(size * 2);
+}
+
+inline uint64_t hash(const std::string& value) {
+    uint64_t h{14695981039346656037ULL};
+    for (auto c : value) {
+        h = (h ^ (unsigned char)c) * 1099511628211ULL;
+    }
+    return h;
+}
+
+template<class H> class timer_map {
+public:
+    /* The timer for the value, created with create(label) the first time */
+    template<class F> H find(const std::string& value, F create) {
+        uint64_t h = hash(value);
+        size_t i = (size_t)h & (capacity() - 1);
+        for (size_t probes = 0 ; probes < capacity() ; probes++) {
+            entry_t * e = _slots[i].load(std::memory_order_acquire);
+            if (e == nullptr) {
+                break;
+            }
+            if (e->hash == h && e->value == value) {
+                return wait(e);
+            }
+            i = (i + 1) & (capacity() - 1);
+        }
+        if (_count.load(std::memory_order_relaxed) >= TAU_WRAP_VALUE_LIMIT ||
+            _count.fetch_add(1) >= TAU_WRAP_VALUE_LIMIT) {
+            return other(create);
+        }
+        // there are at most half as many entries as slots, so one is empty
+        entry_t * mine = new entry_t(h, value);
+        for (size_t probes = 0 ; probes < capacity() ; probes++) {
+            entry_t * expected{nullptr};
+            if (_slots[i].compare_exchange_strong(expected, mine, std::memory_order_acq_rel)) {
+                return ready(mine, create(value));
+            }
+            // another thread is adding the same value, it doesn't count twice
+            if (expected->hash == h && expected->value == value) {
+                delete mine;
+                _count.fetch_sub(1);
+                return wait(expected);
+            }
+            i = (i + 1) & (capacity() - 1);
+        }
+        delete mine;
+        return other(create);
+    }
+private:
+    typedef struct entry {
+        entry(uint64_t h, const std::string& v) : hash(h), value(v), handle(), done(false) {}
+        uint64_t hash;
+        std::string value;
+        H handle;
+        std::atomic<bool> done;
+    } entry_t;
+    std::atomic<entry_t*> _slots[capacity()];
+    std::atomic<entry_t*> _overflow;
+    std::atomic<size_t> _count;
+    static H ready(entry_t * e, H handle) {
+        e->handle = handle;
+        e->done.store(true, std::memory_order_release);
+        return handle;
+    }
+    /* The thread that claimed the entry may still be creating the timer */
+    static H wait(entry_t * e) {
+        while (!e->done.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        return e->handle;
+    }
+    template<class F> H other(F create) {
+        entry_t * expected = _overflow.load(std::memory_order_acquire);
+        if (expected != nullptr) {
+            return wait(expected);
+        }
+        entry_t * mine = new entry_t(0, "");
+        if (_overflow.compare_exchange_strong(expected, mine, std::memory_order_acq_rel)) {
+            return ready(mine, create("other values"));
+        }
+        delete mine;
+        return wait(expected);
+    }
+};
+
+} // namespace wrap_values
+)values";
+
+constexpr const char * builtinValueMacro = R"(
+#define WRAPPER_VALUE(name, value) \
+  static wrap_values::timer_map<size_t> tauValues; \
+  size_t tauFI = tauValues.find(wrap_values::key(value), [&](const std::string& label) { \
+    return wrap_profiler::instance().add_timer(wrap_values::timer_name(name, label).c_str()); \
+  }); \
+  wrap_profiler::scoped_timer tauFProf(tauFI);
+)";
+
+/* Call sites.  Each wrapper keeps a table from the return address of its
+ * calls (where the application called the library) to a call count,
+ * without locks: the slots are claimed with compare-and-swap.  After
+ * TAU_WRAP_CALL_SITE_LIMIT call sites the rest are counted together.
+ * At exit the call sites are looked up with dladdr() and written to
+ * wrapper_callsites.<pid>.txt, with the offset in the object file for
+ * addr2line when the function isn't exported. */
+constexpr const char * callSiteTables = R"callsites(
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+
+namespace wrap_callsites {
+
+/* A power of two, at least twice the limit */
+constexpr size_t capacity(size_t size = 16) {
+    return size >= 2 * TAU_WRAP_CALL_SITE_LIMIT ? size : capacity(size * 2);
+}
+
+typedef struct site {
+    std::atomic<uintptr_t> address;
+    std::atomic<uint64_t> calls;
+} site_t;
+
+class table;
+inline void add_table(table * t);
+
+class table {
+public:
+    table(const char * name) : _name(name) {
+        add_table(this);
+    }
+    void record(void * returnAddress) {
+        uintptr_t address = (uintptr_t)returnAddress;
+        size_t i = (size_t)((address >> 2) * 0x9e3779b97f4a7c15ULL) & (capacity() - 1);
+        for (size_t probes = 0 ; probes < capacity() ; probes++) {
+            uintptr_t current = _sites[i].address.load(std::memory_order_acquire);
+            if (current == address) {
+                _sites[i].calls.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (current == 0) {
+                if (_count.load(std::memory_order_relaxed) >= TAU_WRAP_CALL_SITE_LIMIT) {
+                    break;
+                }
+                if (_sites[i].address.compare_exchange_strong(current, address)) {
+                    _count.fetch_add(1);
+                    _sites[i].calls.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                if (current == address) {
+                    _sites[i].calls.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+            }
+            i = (i + 1) & (capacity() - 1);
+        }
+        _others.fetch_add(1, std::memory_order_relaxed);
+    }
+    void write(FILE * out) {
+        std::vector<std::pair<uint64_t, uintptr_t>> sites;
+        for (size_t i = 0 ; i < capacity() ; i++) {
+            uintptr_t address = _sites[i].address.load();
+            if (address != 0) {
+                sites.push_back(std::make_pair(_sites[i].calls.load(), address));
+            }
+        }
+        std::sort(sites.rbegin(), sites.rend());
+        fprintf(out, "%s:\n", _name);
+        for (auto& s : sites) {
+            fprintf(out, "%12llu  %s\n", (unsigned long long)s.first,
+                symbolize(s.second).c_str());
+        }
+        if (_others.load() > 0) {
+            fprintf(out, "%12llu  (other call sites)\n",
+                (unsigned long long)_others.load());
+        }
+        fprintf(out, "\n");
+    }
+private:
+    // the tables are written at exit, so they have nothing to destroy
+    const char * _name;
+    site_t _sites[capacity()];
+    std::atomic<size_t> _count{0};
+    std::atomic<uint64_t> _others{0};
+    /* The return address is after the call, so look up the byte before it */
+    static std::string symbolize(uintptr_t address) {
+        char buffer[64];
+        Dl_info info;
+        if (dladdr((void*)(address - 1), &info) == 0 || info.dli_fname == nullptr) {
+            snprintf(buffer, sizeof(buffer), "0x%llx", (unsigned long long)address);
+            return buffer;
+        }
+        std::string result;
+        if (info.dli_sname != nullptr) {
+            int status = 0;
+            char * demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            result = (status == 0 && demangled != nullptr) ? demangled : info.dli_sname;
+            free(demangled);
+            snprintf(buffer, sizeof(buffer), "+0x%llx ",
+                (unsigned long long)(address - (uintptr_t)info.dli_saddr));
+            result += buffer;
+        }
+        snprintf(buffer, sizeof(buffer), "+0x%llx)",
+            (unsigned long long)(address - (uintptr_t)info.dli_fbase));
+        return result + "(" + info.dli_fname + buffer;
+    }
+};
+
+typedef struct registry {
+    std::mutex lock;
+    std::vector<table*> tables;
+} registry_t;
+
+/* Never destroyed, the call sites are written by an exit handler */
+inline registry_t& get_registry() {
+    static registry_t * r{nullptr};
+    static std::once_flag once;
+    std::call_once(once, []() {
+        r = new registry_t();
+        atexit([]() {
+            registry_t& r = get_registry();
+            std::lock_guard<std::mutex> guard(r.lock);
+            char filename[64];
+            snprintf(filename, sizeof(filename), "wrapper_callsites.%d.txt", (int)getpid());
+            FILE * out = fopen(filename, "w");
+            if (out == nullptr) {
+                perror(filename);
+                return;
+            }
+            for (auto t : r.tables) {
+                t->write(out);
+            }
+            fclose(out);
+        });
+    });
+    return *r;
+}
+
+inline void add_table(table * t) {
+    registry_t& r = get_registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.tables.push_back(t);
+}
+
+} // namespace wrap_callsites
+)callsites";
+
+/* Latency histograms.  Each wrapper keeps a log-linear histogram of the
+ * time its calls take, in nanoseconds: exact below 32ns, then 32 buckets
+ * per power of two (so within about 3%).  Each thread counts in its own
+ * buckets, which only it writes, so recording takes no locks or
+ * read-modify-writes (a thread's first call adds its buckets to the list
+ * with compare-and-swap).  The threads are only added up when the
+ * histograms are written, to wrapper_latency.<pid>.json at exit or by
+ * calling tau_wrap_latency_snapshot(). */
+constexpr const char * latencyHistograms = R"latency(
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+namespace wrap_latency {
+
+constexpr int sub_bits{5};
+constexpr uint64_t sub_buckets{1ULL << sub_bits};
+// 2^48 ns is over three days, longer calls are counted as that
+constexpr int max_bits{48};
+constexpr size_t bucket_count{(max_bits - sub_bits + 1) * sub_buckets};
+
+inline uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline size_t bucket(uint64_t ns) {
+    if (ns >= (1ULL << max_bits)) {
+        ns = (1ULL << max_bits) - 1;
+    }
+    if (ns < sub_buckets) {
+        return ns;
+    }
+    int magnitude = 63 - __builtin_clzll(ns);
+    return (magnitude - sub_bits + 1) * sub_buckets
+        + ((ns >> (magnitude - sub_bits)) - sub_buckets);
+}
+
+/* The largest value counted in the bucket */
+inline uint64_t highest(size_t i) {
+    if (i < sub_buckets) {
+        return i;
+    }
+    int magnitude = i / sub_buckets + sub_bits - 1;
+    uint64_t sub = i % sub_buckets + sub_buckets;
+    return ((sub + 1) << (magnitude - sub_bits)) - 1;
+}
+
+/* One thread's counts.  Only that thread writes them, the atomics are
+ * so that they can be read while it does. */
+class counts_t {
+public:
+    counts_t() {
+        for (size_t i = 0 ; i < bucket_count ; i++) {
+            buckets[i].store(0, std::memory_order_relaxed);
+        }
+    }
+    void add(uint64_t ns) {
+        increment(buckets[bucket(ns)], 1);
+        increment(sum, ns);
+        if (ns > max.load(std::memory_order_relaxed)) {
+            max.store(ns, std::memory_order_relaxed);
+        }
+    }
+    std::atomic<uint64_t> buckets[bucket_count];
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+    // the other threads counting for the same histogram
+    counts_t * next{nullptr};
+private:
+    static void increment(std::atomic<uint64_t>& value, uint64_t amount) {
+        value.store(value.load(std::memory_order_relaxed) + amount,
+            std::memory_order_relaxed);
+    }
+};
+
+class histogram;
+inline void add_histogram(histogram * h);
+
+/* The counts of the current thread, by histogram id.  Never destroyed,
+ * so that calls made while the thread exits are still counted. */
+inline std::vector<counts_t*>& thread_counts() {
+    static thread_local std::vector<counts_t*> * counts{new std::vector<counts_t*>()};
+    return *counts;
+}
+
+class histogram {
+public:
+    histogram(const char * name) : _name(name), _id(next_id()) {
+        add_histogram(this);
+    }
+    void record(uint64_t ns) {
+        std::vector<counts_t*>& counts = thread_counts();
+        if (_id >= counts.size()) {
+            counts.resize(_id + 1, nullptr);
+        }
+        if (counts[_id] == nullptr) {
+            counts_t * c = new counts_t();
+            c->next = _threads.load();
+            while (!_threads.compare_exchange_weak(c->next, c)) {}
+            counts[_id] = c;
+        }
+        counts[_id]->add(ns);
+    }
+    /* Adds up the threads, and writes the percentiles as a JSON object */
+    bool write(FILE * out, bool first) {
+        std::vector<uint64_t> buckets(bucket_count, 0);
+        uint64_t count{0}, sum{0}, max{0};
+        for (counts_t * t = _threads.load() ; t != nullptr ; t = t->next) {
+            for (size_t i = 0 ; i < bucket_count ; i++) {
+                uint64_t n = t->buckets[i].load(std::memory_order_relaxed);
+                buckets[i] += n;
+                count += n;
+            }
+            sum += t->sum.load(std::memory_order_relaxed);
+            max = std::max(max, t->max.load(std::memory_order_relaxed));
+        }
+        if (count == 0) {
+            return false;
+        }
+        fprintf(out, "%s\n    {\"name\": \"", first ? "" : ",");
+        for (const char * c = _name ; *c != '\0' ; c++) {
+            if (*c == '"' || *c == '\\') {
+                fputc('\\', out);
+            }
+            fputc(*c, out);
+        }
+        fprintf(out, "\", \"count\": %llu, \"mean\": %.1f", (unsigned long long)count,
+            (double)sum / (double)count);
+        const char * names[] = {"p50", "p99", "p999"};
+        const double fractions[] = {0.5, 0.99, 0.999};
+        for (int p = 0 ; p < 3 ; p++) {
+            // the first bucket that gets to that many calls
+            uint64_t rank = (uint64_t)(fractions[p] * (double)count + 0.999999);
+            uint64_t seen{0};
+            size_t i{0};
+            while (i < bucket_count - 1 && seen + buckets[i] < rank) {
+                seen += buckets[i++];
+            }
+            fprintf(out, ", \"%s\": %llu", names[p],
+                (unsigned long long)std::min(highest(i), max));
+        }
+        fprintf(out, ", \"max\": %llu}", (unsigned long long)max);
+        return true;
+    }
+private:
+    // the histograms are written at exit, so they have nothing to destroy
+    const char * _name;
+    size_t _id;
+    std::atomic<counts_t*> _threads{nullptr};
+    static size_t next_id() {
+        static std::atomic<size_t> id{0};
+        return id++;
+    }
+};
+
+typedef struct registry {
+    std::mutex lock;
+    std::vector<histogram*> histograms;
+} registry_t;
+
+inline registry_t& get_registry();
+
+inline int write(const char * filename) {
+    char name[64];
+    if (filename == nullptr) {
+        snprintf(name, sizeof(name), "wrapper_latency.%d.json", (int)getpid());
+        filename = name;
+    }
+    FILE * out = fopen(filename, "w");
+    if (out == nullptr) {
+        perror(filename);
+        return -1;
+    }
+    registry_t& r = get_registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    fprintf(out, "{\n  \"units\": \"ns\",\n  \"functions\": [");
+    bool first{true};
+    for (auto h : r.histograms) {
+        if (h->write(out, first)) {
+            first = false;
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+    fclose(out);
+    return 0;
+}
+
+/* Never destroyed, the histograms are written by an exit handler */
+inline registry_t& get_registry() {
+    static registry_t * r{nullptr};
+    static std::once_flag once;
+    std::call_once(once, []() {
+        r = new registry_t();
+        atexit([]() { write(nullptr); });
+    });
+    return *r;
+}
+
+inline void add_histogram(histogram * h) {
+    registry_t& r = get_registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.histograms.push_back(h);
+}
+
+} // namespace wrap_latency
+)latency";
+
+/* So that the application can write the histograms when it wants to, e.g.
+ * after each step, found with dlsym(RTLD_DEFAULT, ...).  A null filename
+ * is wrapper_latency.<pid>.json. */
+constexpr const char * latencySnapshot = R"(
+extern "C" int tau_wrap_latency_snapshot(const char * filename) {
+    return wrap_latency::write(filename);
+}
+)";